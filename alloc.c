@@ -0,0 +1,379 @@
+#include "alloc.h"
+#include "memory.h"
+#include "node.h"
+
+
+//! @brief Number of slots tracked by each word of a bitmap
+#define SLOTS_PER_WORD (64)
+//! @brief Number of bitmap words needed to cover one level
+#define WORDS_PER_LEVEL \
+	((MAX_NODES_PER_LEVEL + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD)
+
+#ifdef ATOMIC_LOCKS
+	#include <stdatomic.h>
+	typedef _Atomic uint64_t bitmap_word_t;
+	#define WORD_LOAD(w)      atomic_load_explicit(&(w), memory_order_relaxed)
+	#define WORD_OR(w, bits)  atomic_fetch_or(&(w), (bits))
+	#define WORD_AND(w, bits) atomic_fetch_and(&(w), (bits))
+	#define TAG_CAS(t, expected, desired) \
+		atomic_compare_exchange_strong(&(t), &(uint8_t){expected}, (desired))
+#else
+	typedef uint64_t bitmap_word_t;
+	#define WORD_LOAD(w) (w)
+	static inline uint64_t fetch_or(uint64_t *w, uint64_t bits) {
+		const uint64_t old = *w;
+		*w |= bits;
+		return old;
+	}
+	static inline uint64_t fetch_and(uint64_t *w, uint64_t bits) {
+		const uint64_t old = *w;
+		*w &= bits;
+		return old;
+	}
+	static inline bool tag_cas(uint8_t *t, uint8_t expected, uint8_t desired) {
+		if (*t != expected) return false;
+		*t = desired;
+		return true;
+	}
+	#define WORD_OR(w, bits)  fetch_or(&(w), (bits))
+	#define WORD_AND(w, bits) fetch_and(&(w), (bits))
+	#define TAG_CAS(t, expected, desired) tag_cas(&(t), (expected), (desired))
+#endif
+
+
+//! @brief Try to claim a free slot according to one word of a bitmap
+//! @param[inout] word   The bitmap word
+//! @param[in]    valid  Mask of the bits in the word which are real slots
+//! @return Index of the slot within the word, or SLOTS_PER_WORD if there were
+//!         none free
+static bptr_t claim_in_word(bitmap_word_t *word, uint64_t valid) {
+	uint64_t free_bits = ~WORD_LOAD(*word) & valid;
+	while (free_bits) {
+		const uint64_t bit = free_bits & -free_bits;
+		// Someone else may claim the same bit first
+		if (!(WORD_OR(*word, bit) & bit)) return __builtin_ctzll(bit);
+		free_bits = ~WORD_LOAD(*word) & valid;
+	}
+	return SLOTS_PER_WORD;
+}
+
+//! @brief Bitmap of which slots in a word hold nodes, read from memory
+//! @param[in] base   Address of the word's first slot
+//! @param[in] valid  Mask of the bits in the word which are real slots
+static uint64_t read_word(bptr_t base, uint64_t valid) {
+	uint64_t bits = 0;
+	for (bptr_t b = 0; b < SLOTS_PER_WORD; ++b) {
+		if (!(valid & (1ULL << b))) break;
+		Node node = mem_read(base + b);
+		if (is_valid(&node)) bits |= 1ULL << b;
+	}
+	return bits;
+}
+
+
+#ifdef ELASTIC_LEVELS
+
+//! @brief Number of chunks memory is divided into
+#define N_CHUNKS (MEM_SIZE / LEVEL_CHUNK_SIZE)
+//! @brief Number of bitmap words covering one chunk
+#define WORDS_PER_CHUNK (LEVEL_CHUNK_SIZE / SLOTS_PER_WORD)
+//! @brief Number of chunks in each region
+#define CHUNKS_PER_REGION (N_CHUNKS / MEM_REGIONS)
+
+_Static_assert(LEVEL_CHUNK_SIZE % SLOTS_PER_WORD == 0,
+	"LEVEL_CHUNK_SIZE must be a multiple of 64");
+_Static_assert(MEM_SIZE % LEVEL_CHUNK_SIZE == 0,
+	"MEM_SIZE must be a whole number of chunks");
+_Static_assert(MAX_LEVELS < 0xFF, "Levels must fit in a chunk tag");
+_Static_assert(N_CHUNKS % MEM_REGIONS == 0,
+	"Memory must divide into regions of whole chunks");
+
+// The empty tree's root leaf sits at address 0, so the first chunk always
+// belongs to the leaves
+chunk_tag_t chunk_tags[N_CHUNKS] = {1};
+//! @brief Set bits mark slots which are in use
+static bitmap_word_t used[MEM_SIZE / SLOTS_PER_WORD];
+//! @brief Chunk within the region at which each level's next search in the
+//!        region starts, so that repeated allocations do not rescan chunks
+//!        which are full
+static bitmap_word_t hint[MAX_LEVELS][MEM_REGIONS];
+
+
+//! @brief Try to claim any free slot in the chunks of a region belonging to
+//!        a level
+static bptr_t claim_any(uint_fast8_t level, bptr_t region) {
+	const bptr_t first = region * CHUNKS_PER_REGION;
+	const bptr_t start = WORD_LOAD(hint[level][region]);
+	for (bptr_t n = 0; n < CHUNKS_PER_REGION; ++n) {
+		const bptr_t c = first + (start + n) % CHUNKS_PER_REGION;
+		if (chunk_level(c) != level) continue;
+		for (bptr_t w = c * WORDS_PER_CHUNK; w < (c+1) * WORDS_PER_CHUNK; ++w) {
+			const bptr_t bit = claim_in_word(&used[w], ~0ULL);
+			if (bit < SLOTS_PER_WORD) {
+				hint[level][region] = c - first;
+				return w * SLOTS_PER_WORD + bit;
+			}
+		}
+	}
+	return INVALID;
+}
+
+//! @brief Hand an unused chunk of a region to a level
+//! @return Index of the chunk, or INVALID if every chunk is in use
+static bptr_t claim_chunk(uint_fast8_t level, bptr_t region) {
+	const bptr_t first = region * CHUNKS_PER_REGION;
+	for (bptr_t c = first; c < first + CHUNKS_PER_REGION; ++c) {
+		if (TAG_CAS(chunk_tags[c], 0, level + 1)) return c;
+	}
+	return INVALID;
+}
+
+//! @brief Check that no slot in a chunk is marked as in use
+static bool chunk_empty(bptr_t c) {
+	for (bptr_t w = c * WORDS_PER_CHUNK; w < (c+1) * WORDS_PER_CHUNK; ++w) {
+		if (WORD_LOAD(used[w])) return false;
+	}
+	return true;
+}
+
+//! @brief Rebuild the bitmaps of one level's chunks from the contents of
+//!        memory
+static void rebuild_level(uint_fast8_t level) {
+	for (bptr_t c = 0; c < N_CHUNKS; ++c) {
+		if (chunk_level(c) != level) continue;
+		for (bptr_t w = c * WORDS_PER_CHUNK; w < (c+1) * WORDS_PER_CHUNK; ++w) {
+			used[w] = read_word(w * SLOTS_PER_WORD, ~0ULL);
+		}
+	}
+	for (bptr_t r = 0; r < MEM_REGIONS; ++r) hint[level][r] = 0;
+}
+
+
+bptr_t alloc_slot(uint_fast8_t level, bptr_t region) {
+	bptr_t addr, chunk;
+	if (level >= MAX_LEVELS || region >= MEM_REGIONS) return INVALID;
+	while ((addr = claim_any(level, region)) == INVALID) {
+		chunk = claim_chunk(level, region);
+		if (chunk == INVALID) {
+			rebuild_level(level);
+			return claim_any(level, region);
+		}
+		hint[level][region] = chunk - region * CHUNKS_PER_REGION;
+	}
+	return addr;
+}
+
+
+//! @brief Find a run of consecutive chunks of a region which are unused or
+//!        empty chunks of a level, and hand them all to the level
+//! @return Index of the first chunk, or INVALID if there is no such run
+static bptr_t claim_run(uint_fast8_t level, bptr_t region, bptr_t n_chunks) {
+	const bptr_t start = region * CHUNKS_PER_REGION;
+	bptr_t run = 0;
+	for (bptr_t c = start; c < start + CHUNKS_PER_REGION; ++c) {
+		const bool usable = chunk_tags[c] == 0
+			|| (chunk_level(c) == level && chunk_empty(c));
+		run = usable ? run + 1 : 0;
+		if (run == n_chunks) {
+			const bptr_t first = c + 1 - n_chunks;
+			for (bptr_t i = first; i <= c; ++i) chunk_tags[i] = level + 1;
+			return first;
+		}
+	}
+	return INVALID;
+}
+
+
+bptr_t alloc_run(uint_fast8_t level, bptr_t region, bptr_t n) {
+	const bptr_t n_chunks = (n + LEVEL_CHUNK_SIZE - 1) / LEVEL_CHUNK_SIZE;
+	bptr_t first;
+	if (level >= MAX_LEVELS || region >= MEM_REGIONS) return INVALID;
+	first = claim_run(level, region, n_chunks);
+	if (first == INVALID) {
+		// Chunks may only look occupied, such as after memory was reset
+		rebuild_level(level);
+		first = claim_run(level, region, n_chunks);
+	}
+	return (first == INVALID) ? INVALID : first * LEVEL_CHUNK_SIZE;
+}
+
+
+void free_run(bptr_t addr, bptr_t n) {
+	const bptr_t first = addr / LEVEL_CHUNK_SIZE;
+	const bptr_t n_chunks = (n + LEVEL_CHUNK_SIZE - 1) / LEVEL_CHUNK_SIZE;
+	for (bptr_t c = first; c < first + n_chunks; ++c) {
+		if (c % CHUNKS_PER_REGION != 0 && chunk_empty(c)) chunk_tags[c] = 0;
+	}
+}
+
+
+bptr_t alloc_root(bptr_t region) {
+	const bptr_t chunk = region * CHUNKS_PER_REGION;
+	if (region >= MEM_REGIONS) return INVALID;
+	// The chunk normally still belongs to the leaves from an earlier tree
+	TAG_CAS(chunk_tags[chunk], 0, 1);
+	return (chunk_level(chunk) == 0) ? chunk * LEVEL_CHUNK_SIZE : INVALID;
+}
+
+
+void claim_slot(bptr_t addr) {
+	WORD_OR(used[addr / SLOTS_PER_WORD], 1ULL << (addr % SLOTS_PER_WORD));
+}
+
+
+void free_slot(bptr_t addr) {
+	WORD_AND(used[addr / SLOTS_PER_WORD], ~(1ULL << (addr % SLOTS_PER_WORD)));
+}
+
+
+void alloc_rebuild() {
+	Node node;
+	for (bptr_t c = 0; c < N_CHUNKS; ++c) {
+		// Chunks are tagged with the level of any node ever placed in them,
+		// and each region's first holds the root of an empty tree
+		uint8_t tag = (c % CHUNKS_PER_REGION == 0) ? 1 : 0;
+		for (bptr_t addr = c * LEVEL_CHUNK_SIZE;
+			addr < (c+1) * LEVEL_CHUNK_SIZE; ++addr) {
+			node = mem_read(addr);
+			if (node.level < MAX_LEVELS) {
+				tag = node.level + 1;
+				break;
+			}
+		}
+		chunk_tags[c] = tag;
+		for (bptr_t w = c * WORDS_PER_CHUNK; w < (c+1) * WORDS_PER_CHUNK; ++w) {
+			used[w] = read_word(w * SLOTS_PER_WORD, ~0ULL);
+		}
+	}
+	for (uint_fast8_t level = 0; level < MAX_LEVELS; ++level) {
+		for (bptr_t r = 0; r < MEM_REGIONS; ++r) hint[level][r] = 0;
+	}
+}
+
+
+bptr_t slots_used(uint_fast8_t level) {
+	bptr_t count = 0;
+	for (bptr_t c = 0; c < N_CHUNKS; ++c) {
+		if (chunk_level(c) != level) continue;
+		for (bptr_t w = c * WORDS_PER_CHUNK; w < (c+1) * WORDS_PER_CHUNK; ++w) {
+			count += __builtin_popcountll(WORD_LOAD(used[w]));
+		}
+	}
+	return count;
+}
+
+#else
+
+//! @brief Number of slots each region has on each level
+#define REGION_SLOTS (MAX_NODES_PER_LEVEL / MEM_REGIONS)
+//! @brief Number of bitmap words covering one region of a level
+#define WORDS_PER_REGION ((REGION_SLOTS + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD)
+
+#if MEM_REGIONS > 1
+_Static_assert(MAX_NODES_PER_LEVEL % (MEM_REGIONS * SLOTS_PER_WORD) == 0,
+	"Levels must divide into regions of whole bitmap words");
+#endif
+
+//! @brief Set bits mark slots which are in use
+static bitmap_word_t used[MAX_LEVELS][WORDS_PER_LEVEL];
+//! @brief Word within the region at which each level's next search in the
+//!        region starts, so that repeated allocations do not rescan a full
+//!        prefix of the region
+static bitmap_word_t hint[MAX_LEVELS][MEM_REGIONS];
+
+
+//! @brief Mask of bits in a word which correspond to real slots
+inline static uint64_t valid_bits(bptr_t word) {
+	const bptr_t remaining = MAX_NODES_PER_LEVEL - word * SLOTS_PER_WORD;
+	return (remaining >= SLOTS_PER_WORD) ? ~0ULL : ((1ULL << remaining) - 1);
+}
+
+//! @brief Try to claim any free slot in a region of a level according to the
+//!        level's bitmap
+static bptr_t claim_any(uint_fast8_t level, bptr_t region) {
+	const bptr_t first = region * WORDS_PER_REGION;
+	const bptr_t start = WORD_LOAD(hint[level][region]);
+	for (bptr_t n = 0; n < WORDS_PER_REGION; ++n) {
+		const bptr_t w = first + (start + n) % WORDS_PER_REGION;
+		const bptr_t bit = claim_in_word(&used[level][w], valid_bits(w));
+		if (bit < SLOTS_PER_WORD) {
+			hint[level][region] = w - first;
+			return level * MAX_NODES_PER_LEVEL + w * SLOTS_PER_WORD + bit;
+		}
+	}
+	return INVALID;
+}
+
+//! @brief Rebuild one level's bitmap from the contents of memory
+static void rebuild_level(uint_fast8_t level) {
+	for (bptr_t w = 0; w < WORDS_PER_LEVEL; ++w) {
+		used[level][w] = read_word(
+			level * MAX_NODES_PER_LEVEL + w * SLOTS_PER_WORD, valid_bits(w));
+	}
+	for (bptr_t r = 0; r < MEM_REGIONS; ++r) hint[level][r] = 0;
+}
+
+
+bptr_t alloc_slot(uint_fast8_t level, bptr_t region) {
+	bptr_t addr;
+	if (level >= MAX_LEVELS || region >= MEM_REGIONS) return INVALID;
+	addr = claim_any(level, region);
+	if (addr == INVALID) {
+		rebuild_level(level);
+		addr = claim_any(level, region);
+	}
+	return addr;
+}
+
+
+bptr_t alloc_run(uint_fast8_t level, bptr_t region, bptr_t n) {
+	// Each region has a single run covering all of its slots on the level
+	if (level >= MAX_LEVELS || region >= MEM_REGIONS || n > REGION_SLOTS) {
+		return INVALID;
+	}
+	return level * MAX_NODES_PER_LEVEL + region * REGION_SLOTS;
+}
+
+
+void free_run(bptr_t addr, bptr_t n) {
+	// Runs are fixed slices of a level, so reserving one changed nothing
+	(void) addr;
+	(void) n;
+}
+
+
+bptr_t alloc_root(bptr_t region) {
+	return (region < MEM_REGIONS) ? region * REGION_SLOTS : INVALID;
+}
+
+
+void claim_slot(bptr_t addr) {
+	const bptr_t slot = addr % MAX_NODES_PER_LEVEL;
+	WORD_OR(used[get_level(addr)][slot / SLOTS_PER_WORD],
+		1ULL << (slot % SLOTS_PER_WORD));
+}
+
+
+void free_slot(bptr_t addr) {
+	const bptr_t slot = addr % MAX_NODES_PER_LEVEL;
+	WORD_AND(used[get_level(addr)][slot / SLOTS_PER_WORD],
+		~(1ULL << (slot % SLOTS_PER_WORD)));
+}
+
+
+void alloc_rebuild() {
+	for (uint_fast8_t level = 0; level < MAX_LEVELS; ++level) {
+		rebuild_level(level);
+	}
+}
+
+
+bptr_t slots_used(uint_fast8_t level) {
+	bptr_t count = 0;
+	for (bptr_t w = 0; w < WORDS_PER_LEVEL; ++w) {
+		count += __builtin_popcountll(WORD_LOAD(used[level][w]));
+	}
+	return count;
+}
+
+#endif
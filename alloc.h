@@ -0,0 +1,105 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include "types.h"
+
+
+#ifdef ELASTIC_LEVELS
+#if defined(ATOMIC_LOCKS) && defined(__cplusplus)
+	#include <atomic>
+	typedef std::atomic<uint8_t> chunk_tag_t;
+#elif defined(ATOMIC_LOCKS)
+	#include <stdatomic.h>
+	typedef _Atomic uint8_t chunk_tag_t;
+#else
+	typedef uint8_t chunk_tag_t;
+#endif
+
+//! @brief One more than the level each chunk of memory has been handed to,
+//!        or 0 for chunks not yet in use
+extern chunk_tag_t chunk_tags[MEM_SIZE / LEVEL_CHUNK_SIZE];
+
+//! @brief Level a chunk of memory has been handed to
+//! @param[in] chunk  Index of the chunk, its first address divided by
+//!                   LEVEL_CHUNK_SIZE
+//! @return The level, or a value no less than MAX_LEVELS if it is unused
+inline static uint_fast8_t chunk_level(bptr_t chunk) {
+	return (uint8_t) (chunk_tags[chunk] - 1);
+}
+#endif
+
+
+//! @brief Pick a free node slot on a level of the memory grid
+//!
+//! Slots are tracked in a per-level bitmap, so a free slot is found a word
+//! at a time rather than by reading every node on the level. Only slots in
+//! the given region of memory are considered, so that trees in different
+//! regions never share nodes. With `-DELASTIC_LEVELS`, a level whose chunks in
+//! the region are full is handed another unused chunk of it. The bitmap is
+//! only a hint: callers must lock the returned slot and check that it is
+//! still empty before using it, since nodes may be written without passing
+//! through the allocator (for instance after @ref mem_reset_all or when
+//! memory is reloaded). Should the level look full, the bitmap for it is
+//! rebuilt from memory once before giving up.
+//! @param[in] level   The level on which to allocate
+//! @param[in] region  The region of memory in which to allocate, that of the
+//!                    tree the slot is for
+//! @return Address of the slot, now marked in use, or INVALID if the level is
+//!         out of space in the region
+bptr_t alloc_slot(uint_fast8_t level, bptr_t region);
+
+//! @brief Reserve a run of consecutive free slots on a level
+//!
+//! For placing many nodes at once, such as when bulk loading, while nothing
+//! else is allocating. The slots are not marked as used; callers should
+//! @ref claim_slot each one as it is filled.
+//! @param[in] level   The level on which to allocate
+//! @param[in] region  The region of memory in which to allocate
+//! @param[in] n       Number of slots needed
+//! @return Address of the first slot, or INVALID if no run is long enough
+bptr_t alloc_run(uint_fast8_t level, bptr_t region, bptr_t n);
+
+//! @brief Give back a run reserved by @ref alloc_run which was not filled
+//!
+//! With `-DELASTIC_LEVELS`, chunks of the run left empty are no longer kept
+//! for the level, apart from each region's first, which holds the root of an
+//! empty tree. Nothing else needs undoing, since the run's slots were never
+//! marked as used.
+//! @param[in] addr  Address of the first slot, as returned by @ref alloc_run
+//! @param[in] n     Number of slots asked for
+void free_run(bptr_t addr, bptr_t n);
+
+//! @brief Slot where an empty tree in a region of memory keeps its root
+//!
+//! A tree starts out as a single empty leaf, which looks free to the
+//! allocator. It is safe from other trees in the region's first leaf slot,
+//! since only the region's own tree allocates there, and that tree only
+//! allocates once the root holds keys. Region 0's is address 0.
+//! @param[in] region  The region of memory
+//! @return Address of the root leaf, or INVALID if the region does not exist
+//!         or its first chunk has been given to another level
+bptr_t alloc_root(bptr_t region);
+
+//! @brief Mark a slot as in use
+//!
+//! For nodes placed at a fixed address rather than through @ref alloc_slot
+void claim_slot(bptr_t addr);
+
+//! @brief Return a slot to its level's pool
+//!
+//! Should be called after the emptied node has been written back
+void free_slot(bptr_t addr);
+
+//! @brief Rebuild every level's bitmap by checking which nodes are in use
+//!
+//! Call after resetting or reloading memory to bring the occupancy counts
+//! up to date. With `-DELASTIC_LEVELS`, this also works out which level each
+//! chunk of memory belongs to from the nodes in it, so it must not run
+//! concurrently with tree operations.
+void alloc_rebuild();
+
+//! @brief Number of slots on a level which the allocator considers in use
+bptr_t slots_used(uint_fast8_t level);
+
+
+#endif
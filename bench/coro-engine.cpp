@@ -0,0 +1,156 @@
+//! @file coro-engine.cpp
+//! @brief Throughput of interleaved operations against the group size
+//!
+//! Loads a large tree with @ref bulk_load and looks up random keys with
+//! @ref search, with @ref search_batch and with
+//! @ref blink::search_interleaved for a range of group sizes. Then inserts
+//! random keys into an empty tree with @ref insert and with
+//! @ref blink::insert_interleaved for the same group sizes. Build from the
+//! repository root against the host memory backend, for example:
+//!
+//!     for f in alloc.c bulk-load.c insert.c insert-helpers.c memory-host.c
+//!         node.c search.c split.c tree-helpers.c; do
+//!         cc -O2 -march=native -DATOMIC_LOCKS -DTREE_ORDER=16
+//!             -DMAX_NODES_PER_LEVEL=262144 -DMAX_LEVELS=6 -I. -c $f; done
+//!     c++ -std=c++20 -O2 -march=native -DATOMIC_LOCKS -DTREE_ORDER=16
+//!         -DMAX_NODES_PER_LEVEL=262144 -DMAX_LEVELS=6 -I.
+//!         bench/coro-engine.cpp *.o -o coro-engine
+//!
+//! Usage: `coro-engine [keys] [lookups]`
+
+#include "coro-engine.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include "bulk-load.h"
+#include "search.h"
+}
+
+
+//! @brief Seconds elapsed while running a function
+template <typename F>
+static double time_s(F &&f) {
+	const auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+//! @brief xorshift64* pseudorandom number generator
+static std::uint64_t next_rand(std::uint64_t &state) {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+
+int main(int argc, char **argv) {
+	const std::size_t n_keys =
+		(argc > 1) ? std::strtoul(argv[1], NULL, 0) : 2000000;
+	const std::size_t n_lookups =
+		(argc > 2) ? std::strtoul(argv[2], NULL, 0) : 4000000;
+	const std::size_t groups[] = {1, 2, 4, 8, 12, 16, 24, 32};
+	std::vector<bkey_t> keys(n_keys), lookups(n_lookups);
+	std::vector<bval_t> values(n_keys);
+	std::vector<bstatusval_t> results(n_lookups);
+	std::vector<ErrorCode> statuses(n_keys);
+	std::uint64_t rng = 88172645463325252ULL;
+	bptr_t root = 0;
+	ErrorCode status;
+	double elapsed;
+
+	auto check_found = [&](char const *method) {
+		for (auto const &r : results) {
+			if (r.status != SUCCESS) {
+				std::fprintf(stderr, "%s failed to find a loaded key\n", method);
+				std::exit(EXIT_FAILURE);
+			}
+		}
+	};
+	auto check_inserted = [&](char const *method) {
+		for (std::size_t i = 0; i < n_keys; ++i) {
+			const bstatusval_t r = search(root, keys[i]);
+			if (statuses[i] != SUCCESS || r.status != SUCCESS
+				|| r.value.data != values[i].data) {
+				std::fprintf(stderr, "%s failed to insert a key\n", method);
+				std::exit(EXIT_FAILURE);
+			}
+		}
+	};
+
+	for (std::size_t i = 0; i < n_keys; ++i) {
+		keys[i] = 2*i + 1;
+		values[i].data = i;
+	}
+	mem_reset_all();
+	status = bulk_load(&root, keys.data(), values.data(), n_keys, TREE_ORDER);
+	if (status != SUCCESS) {
+		std::fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+		return EXIT_FAILURE;
+	}
+	for (auto &key : lookups) key = keys[next_rand(rng) % n_keys];
+
+	std::printf("op,method,group,count,seconds,mops\n");
+	auto report = [](char const *op, char const *method, std::size_t group,
+			std::size_t count, double seconds) {
+		std::printf("%s,%s,%zu,%zu,%.4f,%.3f\n",
+			op, method, group, count, seconds, count / seconds / 1e6);
+	};
+
+	elapsed = time_s([&] {
+		for (std::size_t i = 0; i < n_lookups; ++i) {
+			results[i] = search(root, lookups[i]);
+		}
+	});
+	check_found("search");
+	report("search", "search", 1, n_lookups, elapsed);
+
+	elapsed = time_s([&] {
+		search_batch(root, lookups.data(), n_lookups, results.data());
+	});
+	check_found("search_batch");
+	report("search", "search_batch", SEARCH_BATCH_WIDTH, n_lookups, elapsed);
+
+	for (std::size_t group : groups) {
+		elapsed = time_s([&] {
+			blink::search_interleaved(
+				root, lookups.data(), n_lookups, results.data(), group);
+		});
+		check_found("search_interleaved");
+		report("search", "interleaved", group, n_lookups, elapsed);
+	}
+
+	// Shuffle the keys to insert them in random order
+	for (std::size_t i = n_keys - 1; i > 0; --i) {
+		const std::size_t j = next_rand(rng) % (i + 1);
+		std::swap(keys[i], keys[j]);
+		std::swap(values[i], values[j]);
+	}
+
+	mem_reset_all();
+	root = 0;
+	elapsed = time_s([&] {
+		for (std::size_t i = 0; i < n_keys; ++i) {
+			statuses[i] = insert(&root, keys[i], values[i]);
+		}
+	});
+	check_inserted("insert");
+	report("insert", "insert", 1, n_keys, elapsed);
+
+	for (std::size_t group : groups) {
+		mem_reset_all();
+		root = 0;
+		elapsed = time_s([&] {
+			blink::insert_interleaved(&root, keys.data(), values.data(),
+				n_keys, statuses.data(), group);
+		});
+		check_inserted("insert_interleaved");
+		report("insert", "interleaved", group, n_keys, elapsed);
+	}
+
+	return EXIT_SUCCESS;
+}
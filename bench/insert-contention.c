@@ -0,0 +1,160 @@
+//! @file insert-contention.c
+//! @brief Measure @ref insert throughput as the number of writers grows
+//!
+//! Bulk loads a tree and then has every thread insert into the same narrow
+//! key range, so that neighbouring inserts land in the same leaves and share
+//! their ancestors. Build from the repository root against the host memory
+//! backend, for example:
+//!
+//!     cc -O2 -march=native -pthread -DATOMIC_LOCKS -DTREE_ORDER=16
+//!         -DMAX_NODES_PER_LEVEL=65536 -DMAX_LEVELS=8 -I.
+//!         bench/insert-contention.c alloc.c bulk-load.c insert.c
+//!         insert-helpers.c memory-host.c node.c search.c split.c
+//!         tree-helpers.c -o insert-contention
+//!
+//! Usage: `insert-contention [max threads] [inserts per thread] [base keys]`
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "bulk-load.h"
+#include "insert.h"
+#include "memory.h"
+#include "search.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+//! @brief Inserts to place into each gap between bulk loaded keys
+#define GAP 3
+
+
+//! @brief Work given to a single writer thread
+typedef struct {
+	//! @brief Tree to insert into
+	bptr_t *root;
+	//! @brief Index of this thread among the writers
+	size_t thread;
+	//! @brief Number of writers
+	size_t n_threads;
+	//! @brief Number of inserts for this thread to make
+	size_t n_inserts;
+	//! @brief Number of base keys the inserts are spread over
+	size_t hot;
+	//! @brief Set to the number of inserts which failed
+	size_t failed;
+	//! @brief Threads wait here so that they start at the same time
+	pthread_barrier_t *start;
+} Writer;
+
+
+//! @brief Current time in nanoseconds from a monotonic clock
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//! @brief Key of the i-th insert across all threads
+//!
+//! Consecutive inserts go to neighbouring gaps, and so are made by different
+//! threads into the same few leaves.
+static bkey_t insert_key(size_t i, size_t hot) {
+	return (GAP+1) * (i % hot) + 1 + (i / hot);
+}
+
+//! @brief Body of a writer thread
+static void *write_keys(void *arg) {
+	Writer *w = arg;
+	pthread_barrier_wait(w->start);
+	for (size_t j = 0; j < w->n_inserts; ++j) {
+		const size_t i = j * w->n_threads + w->thread;
+		const bval_t value = {.data = i};
+		if (insert(w->root, insert_key(i, w->hot), value) != SUCCESS) {
+			w->failed++;
+		}
+	}
+	return NULL;
+}
+
+
+int main(int argc, char **argv) {
+	const size_t max_threads = (argc > 1) ? strtoul(argv[1], NULL, 0) : 8;
+	const size_t per_thread = (argc > 2) ? strtoul(argv[2], NULL, 0) : 50000;
+	const size_t n_base = (argc > 3) ? strtoul(argv[3], NULL, 0) : 200000;
+	bkey_t *keys = malloc(n_base * sizeof(bkey_t));
+	bval_t *values = malloc(n_base * sizeof(bval_t));
+	pthread_t *threads = malloc(max_threads * sizeof(pthread_t));
+	Writer *writers = malloc(max_threads * sizeof(Writer));
+	pthread_barrier_t start;
+	bptr_t root;
+	ErrorCode status;
+
+	if (!keys || !values || !threads || !writers) {
+		fprintf(stderr, "Allocation failed\n");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_base; ++i) {
+		keys[i] = (GAP+1) * i;
+		values[i].data = i;
+	}
+
+	printf("threads,inserts,seconds,mops\n");
+	for (size_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+		const size_t total = n_threads * per_thread;
+		const size_t hot = (total + GAP - 1) / GAP;
+		size_t failed = 0;
+		double elapsed;
+
+		if (hot > n_base) {
+			fprintf(stderr, "Too few base keys for %zu threads\n", n_threads);
+			return EXIT_FAILURE;
+		}
+		// Half full leaves leave room for inserts before the first splits
+		root = 0;
+		mem_reset_all();
+		status = bulk_load(&root, keys, values, n_base, TREE_ORDER/2);
+		if (status != SUCCESS) {
+			fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+			return EXIT_FAILURE;
+		}
+
+		pthread_barrier_init(&start, NULL, n_threads + 1);
+		for (size_t t = 0; t < n_threads; ++t) {
+			writers[t] = (Writer){
+				.root = &root, .thread = t, .n_threads = n_threads,
+				.n_inserts = per_thread, .hot = hot, .failed = 0,
+				.start = &start
+			};
+			pthread_create(&threads[t], NULL, write_keys, &writers[t]);
+		}
+		elapsed = now_ns();
+		pthread_barrier_wait(&start);
+		for (size_t t = 0; t < n_threads; ++t) {
+			pthread_join(threads[t], NULL);
+			failed += writers[t].failed;
+		}
+		elapsed = now_ns() - elapsed;
+		pthread_barrier_destroy(&start);
+
+		// Every key must have made it into the tree
+		for (size_t i = 0; i < total; ++i) {
+			const bstatusval_t result = search(root, insert_key(i, hot));
+			if (result.status != SUCCESS || result.value.data != (bdata_t) i) failed++;
+		}
+		if (failed) {
+			fprintf(stderr, "%zu inserts with %zu threads were lost\n",
+				failed, n_threads);
+			return EXIT_FAILURE;
+		}
+		printf("%zu,%zu,%.4f,%.3f\n",
+			n_threads, total, elapsed / 1e9, total / (elapsed / 1e3));
+	}
+
+	free(keys);
+	free(values);
+	free(threads);
+	free(writers);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+//! @file search-batch.c
+//! @brief Compare @ref search_batch against a loop of single-key searches
+//!
+//! Loads a large tree with @ref bulk_load and then looks up the same random
+//! keys both ways, for a range of batch sizes. Build from the repository
+//! root against the host memory backend, for example:
+//!
+//!     cc -O2 -march=native -DATOMIC_LOCKS -DTREE_ORDER=16
+//!         -DMAX_NODES_PER_LEVEL=262144 -DMAX_LEVELS=6 -I.
+//!         bench/search-batch.c alloc.c bulk-load.c insert-helpers.c
+//!         memory-host.c node.c search.c -o search-batch
+//!
+//! Usage: `search-batch [keys] [lookups]`
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "bulk-load.h"
+#include "memory.h"
+#include "search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+//! @brief Current time in nanoseconds from a monotonic clock
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//! @brief xorshift64* pseudorandom number generator
+static uint64_t next_rand(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+
+int main(int argc, char **argv) {
+	const size_t n_keys = (argc > 1) ? strtoul(argv[1], NULL, 0) : 2000000;
+	const size_t n_lookups = (argc > 2) ? strtoul(argv[2], NULL, 0) : 4000000;
+	const size_t batch_sizes[] = {64, 128, 256, 512, 1024};
+	bkey_t *keys = malloc(n_keys * sizeof(bkey_t));
+	bval_t *values = malloc(n_keys * sizeof(bval_t));
+	bkey_t *lookups = malloc(n_lookups * sizeof(bkey_t));
+	bstatusval_t *results = malloc(n_lookups * sizeof(bstatusval_t));
+	uint64_t rng = 88172645463325252ULL;
+	bptr_t root = 0;
+	ErrorCode status;
+	size_t found = 0;
+	double start, elapsed;
+
+	if (!keys || !values || !lookups || !results) {
+		fprintf(stderr, "Allocation failed\n");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_keys; ++i) {
+		keys[i] = 2*i + 1;
+		values[i].data = i;
+	}
+	mem_reset_all();
+	status = bulk_load(&root, keys, values, n_keys, TREE_ORDER);
+	if (status != SUCCESS) {
+		fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_lookups; ++i) {
+		lookups[i] = keys[next_rand(&rng) % n_keys];
+	}
+
+	printf("method,batch,lookups,seconds,mops\n");
+	start = now_ns();
+	for (size_t i = 0; i < n_lookups; ++i) {
+		results[i] = search(root, lookups[i]);
+	}
+	elapsed = now_ns() - start;
+	for (size_t i = 0; i < n_lookups; ++i) found += (results[i].status == SUCCESS);
+	printf("search,1,%zu,%.4f,%.3f\n",
+		n_lookups, elapsed / 1e9, n_lookups / (elapsed / 1e3));
+
+	for (size_t b = 0; b < sizeof(batch_sizes)/sizeof(batch_sizes[0]); ++b) {
+		start = now_ns();
+		for (size_t i = 0; i < n_lookups; i += batch_sizes[b]) {
+			const size_t n = (n_lookups - i < batch_sizes[b])
+				? n_lookups - i : batch_sizes[b];
+			search_batch(root, lookups + i, n, results + i);
+		}
+		elapsed = now_ns() - start;
+		for (size_t i = 0; i < n_lookups; ++i) {
+			found += (results[i].status == SUCCESS);
+		}
+		printf("search_batch,%zu,%zu,%.4f,%.3f\n",
+			batch_sizes[b], n_lookups, elapsed / 1e9,
+			n_lookups / (elapsed / 1e3));
+	}
+
+	if (found != n_lookups * (1 + sizeof(batch_sizes)/sizeof(batch_sizes[0]))) {
+		fprintf(stderr, "Lookups failed to find loaded keys\n");
+		return EXIT_FAILURE;
+	}
+	free(keys);
+	free(values);
+	free(lookups);
+	free(results);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+//! @file string-keys.cpp
+//! @brief Measure @ref blink::StringNode trees on path-like string keys
+//!
+//! Generates unique keys shaped like URL paths, which share long prefixes,
+//! inserts them in random order from several threads and then searches for
+//! each of them. Prints the throughput of each phase, followed by the memory
+//! taken per key by the tree's nodes next to the size of the key itself and
+//! that of the same key and value held as a `std::string` and a value.
+//! Build from the repository root, for example:
+//!
+//!     c++ -std=c++17 -O2 -march=native -I. bench/string-keys.cpp
+//!         -lpthread -o string-keys
+//!
+//! Usage: `string-keys [keys] [threads]`
+
+#include "string-node.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+
+using PathNode = blink::StringNode<std::uint64_t>;
+using PathTree = blink::BLinkTree<std::string, std::uint64_t, PathNode::order,
+	blink::HostMemory<PathNode, (1 << 17)>>;
+
+
+//! @brief A random path of a few segments, sometimes ending in an ID
+static std::string make_path(std::mt19937_64 &rng) {
+	static char const *const segments[] = {
+		"api", "v1", "v2", "users", "orders", "items", "search", "static",
+		"images", "assets", "account", "settings", "products", "reviews",
+	};
+	constexpr std::size_t n_segments = sizeof(segments) / sizeof(*segments);
+	std::string path;
+	const std::size_t depth = 2 + rng() % 4;
+	for (std::size_t i = 0; i < depth; ++i) {
+		path += '/';
+		path += segments[rng() % n_segments];
+	}
+	if (rng() % 4) {
+		path += '/';
+		path += std::to_string(rng() % 1000000);
+	}
+	if (path.size() > PathNode::max_key_length) {
+		path.resize(PathNode::max_key_length);
+	}
+	return path;
+}
+
+
+//! @brief Run a phase across threads, each taking every nth key, and print
+//!        its throughput in millions of operations per second
+template <typename F>
+static void measure(char const *phase, std::vector<std::string> const &keys,
+	unsigned threads, F f) {
+	std::vector<std::thread> workers;
+	std::vector<std::size_t> failed(threads);
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t] {
+			for (std::size_t i = t; i < keys.size(); i += threads) {
+				failed[t] += !f(keys[i], i);
+			}
+		});
+	}
+	for (std::thread &w : workers) w.join();
+	const std::chrono::duration<double> seconds =
+		std::chrono::steady_clock::now() - start;
+	std::size_t total = 0;
+	for (std::size_t n : failed) total += n;
+	std::printf("%-6s %8.3f Mops/s %zu failed\n",
+		phase, keys.size() / seconds.count() / 1e6, total);
+}
+
+
+int main(int argc, char **argv) {
+	const std::size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10)
+		: 1000000;
+	const unsigned threads = (argc > 2) ? std::strtoul(argv[2], nullptr, 10)
+		: 1;
+	std::mt19937_64 rng(42);
+	std::unordered_set<std::string> unique;
+	while (unique.size() < n) unique.insert(make_path(rng));
+	std::vector<std::string> keys(unique.begin(), unique.end());
+	std::shuffle(keys.begin(), keys.end(), rng);
+
+	auto tree = std::make_unique<PathTree>();
+	measure("insert", keys, threads, [&](std::string const &key, std::size_t i) {
+		return tree->insert(key, i) == SUCCESS;
+	});
+	measure("search", keys, threads, [&](std::string const &key, std::size_t i) {
+		std::uint64_t value;
+		return tree->search(key, value) == SUCCESS && value == i;
+	});
+
+	std::size_t key_bytes = 0;
+	for (std::string const &key : keys) key_bytes += key.size();
+	const double per_key = (double) key_bytes / n;
+	// Anything longer than the small string buffer takes its own allocation
+	std::size_t string_bytes = 0;
+	for (std::string const &key : keys) {
+		string_bytes += sizeof(std::string) + sizeof(std::uint64_t)
+			+ ((key.size() >= sizeof(std::string) / 2) ? key.size() + 1 : 0);
+	}
+	std::printf("nodes  %zu of %zu bytes\n",
+		tree->memory().in_use(), sizeof(PathNode));
+	std::printf("bytes/key: tree %.1f, key %.1f, std::string and value %.1f\n",
+		(double) tree->memory().in_use() * sizeof(PathNode) / n, per_key,
+		(double) string_bytes / n);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Build bench/workload.c once per tree configuration and run every workload,
+# key distribution and thread count against each, printing one CSV table.
+#
+# Run from anywhere; binaries go under bench/build. Every setting can be
+# overridden from the environment, for example:
+#
+#     CONFIGS="8:262144:7 16:131072:6" THREADS="1 4" bench/sweep.sh > out.csv
+#
+# CONFIGS holds TREE_ORDER:MAX_NODES_PER_LEVEL:MAX_LEVELS triples. A
+# configuration too small for the loaded keys reports the failure and is
+# skipped. Inserts that run out of room count towards the errors column.
+# To compare node layouts, run again with -DALIGNED_NODES added to CFLAGS and
+# a separate BUILD directory, and likewise -DNODE_CACHE to try the node cache.
+
+set -eu
+
+cd "$(dirname "$0")/.."
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -march=native}
+CONFIGS=${CONFIGS:-"4:262144:12 8:131072:7 16:65536:6 32:32768:5 64:16384:4"}
+WORKLOADS=${WORKLOADS:-"read write scan mixed"}
+DISTRIBUTIONS=${DISTRIBUTIONS:-"uniform zipfian sequential"}
+THREADS=${THREADS:-"1 2 4 8"}
+KEYS=${KEYS:-200000}
+OPS=${OPS:-100000}
+BUILD=${BUILD:-bench/build}
+
+SOURCES="bench/workload.c alloc.c bulk-load.c erase.c forest.c insert.c
+	insert-helpers.c memory-host.c memory-trace.c node.c node-cache.c scan.c
+	search.c split.c stats.c tree-helpers.c"
+
+mkdir -p "$BUILD"
+header=
+for config in $CONFIGS; do
+	order=${config%%:*}
+	rest=${config#*:}
+	nodes=${rest%%:*}
+	levels=${rest#*:}
+	binary="$BUILD/workload-o$order-n$nodes-l$levels"
+
+	# shellcheck disable=SC2086
+	$CC $CFLAGS -pthread -DATOMIC_LOCKS -DTREE_ORDER="$order" \
+		-DMAX_NODES_PER_LEVEL="$nodes" -DMAX_LEVELS="$levels" -I. \
+		$SOURCES -lm -o "$binary"
+
+	for workload in $WORKLOADS; do
+		for distribution in $DISTRIBUTIONS; do
+			for threads in $THREADS; do
+				"$binary" -w "$workload" -d "$distribution" -t "$threads" \
+					-n "$KEYS" -o "$OPS" $header || {
+					echo "Skipped $binary -w $workload -d $distribution" \
+						"-t $threads" >&2
+					continue
+				}
+				header=-H
+			done
+		done
+	done
+done
@@ -0,0 +1,163 @@
+//! @file template-tree.cpp
+//! @brief Compare the C tree with instantiations of @ref blink::BLinkTree
+//!
+//! Inserts the same shuffled keys into the C API, into @ref blink::CTree over
+//! the same memory, and into templated trees with their own memory, one with
+//! the C tree's types and order and one with 64-bit keys and 16-byte values,
+//! then searches each for every key. Prints the throughput of each phase.
+//! Finally checks that the C API and @ref blink::CTree can share a tree, with
+//! each inserting half of the keys into it and both then searching for all.
+//! Build from the repository root against the host memory backend, for
+//! example:
+//!
+//!     for f in alloc.c insert.c insert-helpers.c memory-host.c node.c
+//!         search.c split.c tree-helpers.c; do
+//!         cc -O2 -march=native -DATOMIC_LOCKS -DTREE_ORDER=16
+//!             -DMAX_NODES_PER_LEVEL=262144 -DMAX_LEVELS=6 -I. -c $f; done
+//!     c++ -std=c++17 -O2 -march=native -DATOMIC_LOCKS -DTREE_ORDER=16
+//!         -DMAX_NODES_PER_LEVEL=262144 -DMAX_LEVELS=6 -I.
+//!         bench/template-tree.cpp *.o -o template-tree
+//!
+//! Usage: `template-tree [keys]`
+
+#include "blink-tree-c.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "insert.h"
+#include "search.h"
+}
+
+
+//! @brief A value twice the size of a 64-bit key
+struct Wide {
+	std::uint64_t a, b;
+};
+
+using NativeTree = blink::BLinkTree<bkey_t, bdata_t, TREE_ORDER,
+	blink::HostMemory<blink::Node<bkey_t, bdata_t, TREE_ORDER>, (1 << 22)>>;
+using WideTree = blink::BLinkTree<std::uint64_t, Wide, TREE_ORDER,
+	blink::HostMemory<blink::Node<std::uint64_t, Wide, TREE_ORDER>, (1 << 22)>>;
+
+
+//! @brief Time a phase and print its throughput in millions of operations
+//!        per second
+template <typename F>
+static void measure(char const *tree, char const *phase, std::size_t n, F f) {
+	const auto start = std::chrono::steady_clock::now();
+	const std::size_t failed = f();
+	const std::chrono::duration<double> seconds =
+		std::chrono::steady_clock::now() - start;
+	std::printf("%-8s %-6s %8.3f Mops/s %zu failed\n",
+		tree, phase, n / seconds.count() / 1e6, failed);
+}
+
+
+int main(int argc, char **argv) {
+	const std::size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10)
+		: 1000000;
+	std::vector<bkey_t> keys(n);
+	std::iota(keys.begin(), keys.end(), 1);
+	std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+	mem_reset_all();
+	alloc_rebuild();
+	bptr_t root = 0;
+	measure("c", "insert", n, [&] {
+		std::size_t failed = 0;
+		for (bkey_t k : keys) {
+			bval_t v;
+			v.data = k;
+			failed += insert(&root, k, v) != SUCCESS;
+		}
+		return failed;
+	});
+	measure("c", "search", n, [&] {
+		std::size_t failed = 0;
+		for (bkey_t k : keys) failed += search(root, k).status != SUCCESS;
+		return failed;
+	});
+
+	mem_reset_all();
+	alloc_rebuild();
+	auto c_tree = std::make_unique<blink::CTree>();
+	measure("ctree", "insert", n, [&] {
+		std::size_t failed = 0;
+		for (bkey_t k : keys) failed += c_tree->insert(k, k) != SUCCESS;
+		return failed;
+	});
+	measure("ctree", "search", n, [&] {
+		std::size_t failed = 0;
+		bdata_t v;
+		for (bkey_t k : keys) failed += c_tree->search(k, v) != SUCCESS;
+		return failed;
+	});
+
+	// Half the keys through each API, handing the root over in between
+	mem_reset_all();
+	alloc_rebuild();
+	root = 0;
+	c_tree = std::make_unique<blink::CTree>();
+	measure("shared", "insert", n, [&] {
+		std::size_t failed = 0;
+		for (std::size_t i = 0; i < n / 2; ++i) {
+			bval_t v;
+			v.data = keys[i];
+			failed += insert(&root, keys[i], v) != SUCCESS;
+		}
+		c_tree->attach(root);
+		for (std::size_t i = n / 2; i < n; ++i) {
+			failed += c_tree->insert(keys[i], keys[i]) != SUCCESS;
+		}
+		return failed;
+	});
+	// Each key is searched for through both APIs
+	measure("shared", "search", 2 * n, [&] {
+		std::size_t failed = 0;
+		bdata_t v;
+		root = c_tree->root();
+		for (bkey_t k : keys) {
+			const bstatusval_t result = search(root, k);
+			failed += result.status != SUCCESS
+				|| result.value.data != (bdata_t) k;
+			failed += c_tree->search(k, v) != SUCCESS || v != (bdata_t) k;
+		}
+		return failed;
+	});
+
+	auto native = std::make_unique<NativeTree>();
+	measure("native", "insert", n, [&] {
+		std::size_t failed = 0;
+		for (bkey_t k : keys) failed += native->insert(k, k) != SUCCESS;
+		return failed;
+	});
+	measure("native", "search", n, [&] {
+		std::size_t failed = 0;
+		bdata_t v;
+		for (bkey_t k : keys) failed += native->search(k, v) != SUCCESS;
+		return failed;
+	});
+
+	auto wide = std::make_unique<WideTree>();
+	measure("wide", "insert", n, [&] {
+		std::size_t failed = 0;
+		for (bkey_t k : keys) {
+			failed += wide->insert(std::uint64_t{k} << 32, Wide{k, k}) != SUCCESS;
+		}
+		return failed;
+	});
+	measure("wide", "search", n, [&] {
+		std::size_t failed = 0;
+		Wide v;
+		for (bkey_t k : keys) {
+			failed += wide->search(std::uint64_t{k} << 32, v) != SUCCESS;
+		}
+		return failed;
+	});
+	return 0;
+}
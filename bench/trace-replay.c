@@ -0,0 +1,406 @@
+//! @file trace-replay.c
+//! @brief Offline analysis of node access traces
+//!
+//! Reads a trace written through @ref memory-trace.h, such as by
+//! `workload -T`, puts its events back in time order and replays them to
+//! report, as CSV tables separated by blank lines:
+//!
+//! - access heat by level, and the hottest nodes;
+//! - how long locks were held, by level, from @ref mem_read_lock to the
+//!   matching @ref mem_write_unlock or @ref mem_unlock;
+//! - the distribution of reuse distances, the number of other nodes accessed
+//!   between two accesses to the same node;
+//! - the hit rate of an LRU cache of each of the given sizes in nodes.
+//!
+//! Reads, locked reads and writes all count as accesses, and plain unlocks
+//! do not. An access hits in an LRU cache of N nodes exactly when its reuse
+//! distance is below N, so one pass serves every size. The node cache of
+//! @ref node-cache.h is set-associative, so it falls somewhat short of these
+//! rates at the same capacity, apart from its pinned levels. The tool does not
+//! depend on the tree's geometry, which it takes from the trace. Build from
+//! the repository root with:
+//!
+//!     cc -O2 -I. bench/trace-replay.c -o trace-replay
+//!
+//! Usage: `trace-replay [-c sizes] [-n hottest] trace`
+//!
+//! `-c` takes a comma-separated list of cache sizes, and `-n` the number of
+//! hottest nodes to list.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "memory-trace.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//! @brief Number of power-of-two reuse distance buckets, enough for any
+//!        32-bit address space
+#define DISTANCE_BUCKETS 34
+
+//! @brief Column names of @ref TraceOp
+static char const *const OP_NAMES[TRACE_OPS] = {
+	"reads", "locked_reads", "writes", "unlocks"
+};
+
+
+//! @brief Whether an event touches the node's contents
+static bool is_access(TraceEvent const *e) {
+	return e->op != TRACE_UNLOCK;
+}
+
+//! @brief Compare 64-bit integers for sorting
+static int compare_u64(void const *a, void const *b) {
+	const uint64_t x = *(uint64_t const *) a;
+	const uint64_t y = *(uint64_t const *) b;
+	return (x > y) - (x < y);
+}
+
+//! @brief Sort events by time, keeping events with equal times in order
+//!
+//! Merge sort, since a thread's events may share a timestamp and must not
+//! be reordered, and the runs in the file are mostly long and sorted.
+//! @param[inout] events  Events to sort
+//! @param[in]    n       Number of events
+//! @return Whether there was memory to sort with
+static bool sort_events(TraceEvent *events, size_t n) {
+	TraceEvent *from = events;
+	TraceEvent *to = malloc(n * sizeof(TraceEvent));
+
+	if (!to && n) return false;
+	for (size_t width = 1; width < n; width *= 2) {
+		for (size_t lo = 0; lo < n; lo += 2*width) {
+			const size_t mid = (lo + width < n) ? lo + width : n;
+			const size_t hi = (lo + 2*width < n) ? lo + 2*width : n;
+			size_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi) {
+				to[k++] = (from[j].time < from[i].time) ? from[j++] : from[i++];
+			}
+			while (i < mid) to[k++] = from[i++];
+			while (j < hi) to[k++] = from[j++];
+		}
+		TraceEvent *swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from != events) {
+		memcpy(events, from, n * sizeof(TraceEvent));
+		free(from);
+	} else {
+		free(to);
+	}
+	return true;
+}
+
+//! @brief Load a whole trace
+//! @param[in]  path      File to read
+//! @param[out] header    The trace's header
+//! @param[out] n_events  Number of events read
+//! @return The events, or NULL on failure, having printed why
+static TraceEvent *read_trace(
+	char const *path, TraceHeader *header, size_t *n_events
+) {
+	FILE *file = fopen(path, "rb");
+	TraceEvent *events = NULL;
+	size_t capacity = 0;
+
+	*n_events = 0;
+	if (!file) {
+		perror(path);
+		return NULL;
+	}
+	if (fread(header, sizeof(*header), 1, file) != 1
+		|| memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic))
+		|| header->event_size != sizeof(TraceEvent)) {
+		fprintf(stderr, "%s is not a trace in this format\n", path);
+		fclose(file);
+		return NULL;
+	}
+	for (;;) {
+		if (*n_events == capacity) {
+			TraceEvent *grown;
+			capacity = capacity ? 2*capacity : 1 << 16;
+			grown = realloc(events, capacity * sizeof(TraceEvent));
+			if (!grown) {
+				fprintf(stderr, "Trace does not fit in memory\n");
+				free(events);
+				fclose(file);
+				return NULL;
+			}
+			events = grown;
+		}
+		const size_t n = fread(events + *n_events, sizeof(TraceEvent),
+			capacity - *n_events, file);
+		*n_events += n;
+		if (*n_events < capacity) break;
+	}
+	if (ferror(file)) {
+		perror(path);
+		free(events);
+		events = NULL;
+	}
+	fclose(file);
+	return events;
+}
+
+
+//! @brief Print accesses of each kind by level, then the hottest nodes
+static void report_heat(TraceHeader const *header, TraceEvent const *events,
+		size_t n_events, size_t n_hottest) {
+	// One extra level for memory not handed to any level
+	const size_t n_levels = header->levels + 1;
+	uint64_t (*ops)[TRACE_OPS] = calloc(n_levels, sizeof(*ops));
+	uint64_t *nodes = calloc(n_levels, sizeof(uint64_t));
+	uint64_t *heat = calloc(header->mem_size, sizeof(uint64_t));
+	uint8_t *level_of = calloc(header->mem_size, sizeof(uint8_t));
+	uint64_t total = 0;
+
+	if (!ops || !nodes || !heat || !level_of) {
+		fprintf(stderr, "Out of memory counting accesses\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < n_events; ++i) {
+		TraceEvent const *e = &events[i];
+		if (e->address >= header->mem_size || e->level >= n_levels
+			|| e->op >= TRACE_OPS) {
+			continue;
+		}
+		ops[e->level][e->op]++;
+		if (!is_access(e)) continue;
+		if (heat[e->address]++ == 0) nodes[e->level]++;
+		level_of[e->address] = e->level;
+		total++;
+	}
+
+	printf("level");
+	for (unsigned op = 0; op < TRACE_OPS; ++op) printf(",%s", OP_NAMES[op]);
+	printf(",nodes,accesses_per_node,share\n");
+	for (size_t l = 0; l < n_levels; ++l) {
+		const uint64_t accesses = ops[l][TRACE_READ] + ops[l][TRACE_READ_LOCK]
+			+ ops[l][TRACE_WRITE_UNLOCK];
+		if (!accesses && !ops[l][TRACE_UNLOCK]) continue;
+		if (l == header->levels) printf("unassigned");
+		else printf("%zu", l);
+		for (unsigned op = 0; op < TRACE_OPS; ++op) {
+			printf(",%" PRIu64, ops[l][op]);
+		}
+		printf(",%" PRIu64 ",%.1f,%.4f\n", nodes[l],
+			nodes[l] ? (double) accesses / nodes[l] : 0.0,
+			total ? (double) accesses / total : 0.0);
+	}
+
+	// Pick out the hottest nodes one at a time, since few are wanted
+	printf("\nhottest,address,level,accesses,share\n");
+	for (size_t rank = 0; rank < n_hottest; ++rank) {
+		uint32_t best = 0;
+		for (uint32_t a = 1; a < header->mem_size; ++a) {
+			if (heat[a] > heat[best]) best = a;
+		}
+		if (!heat[best]) break;
+		printf("%zu,%" PRIu32 ",%u,%" PRIu64 ",%.4f\n", rank + 1, best,
+			(unsigned) level_of[best], heat[best],
+			(double) heat[best] / total);
+		heat[best] = 0;
+	}
+	free(ops);
+	free(nodes);
+	free(heat);
+	free(level_of);
+}
+
+
+//! @brief Print lock hold time percentiles by level
+static void report_locks(TraceHeader const *header, TraceEvent const *events,
+		size_t n_events) {
+	const size_t n_levels = header->levels + 1;
+	// Time each node was locked at, or UINT64_MAX while it is not locked
+	uint64_t *locked_at = malloc(header->mem_size * sizeof(uint64_t));
+	uint64_t **holds = calloc(n_levels, sizeof(uint64_t *));
+	size_t *n_holds = calloc(n_levels, sizeof(size_t));
+	size_t *capacity = calloc(n_levels, sizeof(size_t));
+	size_t unmatched = 0;
+
+	if (!locked_at || !holds || !n_holds || !capacity) {
+		fprintf(stderr, "Out of memory timing locks\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(locked_at, 0xFF, header->mem_size * sizeof(uint64_t));
+	for (size_t i = 0; i < n_events; ++i) {
+		TraceEvent const *e = &events[i];
+		if (e->address >= header->mem_size || e->level >= n_levels
+			|| e->op >= TRACE_OPS) {
+			continue;
+		}
+		if (e->op == TRACE_READ_LOCK) {
+			if (locked_at[e->address] != UINT64_MAX) unmatched++;
+			locked_at[e->address] = e->time;
+			continue;
+		}
+		if (e->op == TRACE_READ) continue;
+		if (locked_at[e->address] == UINT64_MAX) {
+			unmatched++;
+			continue;
+		}
+		if (n_holds[e->level] == capacity[e->level]) {
+			capacity[e->level] = capacity[e->level] ? 2*capacity[e->level] : 1024;
+			holds[e->level] = realloc(holds[e->level],
+				capacity[e->level] * sizeof(uint64_t));
+			if (!holds[e->level]) {
+				fprintf(stderr, "Out of memory timing locks\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		holds[e->level][n_holds[e->level]++] = e->time - locked_at[e->address];
+		locked_at[e->address] = UINT64_MAX;
+	}
+
+	printf("\nlevel,holds,mean_ns,p50_ns,p99_ns,max_ns\n");
+	for (size_t l = 0; l < n_levels; ++l) {
+		const size_t n = n_holds[l];
+		uint64_t sum = 0;
+		if (!n) continue;
+		qsort(holds[l], n, sizeof(uint64_t), compare_u64);
+		for (size_t i = 0; i < n; ++i) sum += holds[l][i];
+		if (l == header->levels) printf("unassigned");
+		else printf("%zu", l);
+		printf(",%zu,%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", n,
+			(double) sum / n, holds[l][n / 2], holds[l][n * 99 / 100],
+			holds[l][n - 1]);
+		free(holds[l]);
+	}
+	// Traces opened or closed while locks were held leave some unmatched
+	if (unmatched) fprintf(stderr, "Unmatched lock events: %zu\n", unmatched);
+	free(locked_at);
+	free(holds);
+	free(n_holds);
+	free(capacity);
+}
+
+
+//! @brief Print the reuse distance distribution and simulated LRU hit rates
+static void report_reuse(TraceHeader const *header, TraceEvent const *events,
+		size_t n_events, uint64_t const *sizes, size_t n_sizes) {
+	// Fenwick tree over access positions, holding a 1 at the latest access to
+	// each node, so that the nodes accessed between two accesses to the same
+	// node are counted in logarithmic time
+	size_t n_accesses = 0;
+	for (size_t i = 0; i < n_events; ++i) n_accesses += is_access(&events[i]);
+	uint32_t *fenwick = calloc(n_accesses + 1, sizeof(uint32_t));
+	// Position of the latest access to each node, counting from 1, or 0
+	size_t *last = calloc(header->mem_size, sizeof(size_t));
+	// Accesses at each exact distance, every distance being below mem_size
+	uint64_t *at_distance = calloc(header->mem_size, sizeof(uint64_t));
+	uint64_t buckets[DISTANCE_BUCKETS] = {0};
+	uint64_t cold = 0, cumulative = 0;
+	size_t position = 0;
+
+	if (!fenwick || !last || !at_distance) {
+		fprintf(stderr, "Out of memory measuring reuse\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < n_events; ++i) {
+		TraceEvent const *e = &events[i];
+		if (!is_access(e) || e->address >= header->mem_size) continue;
+		++position;
+		const size_t prev = last[e->address];
+		if (prev) {
+			uint64_t distance = 0;
+			for (size_t p = position - 1; p > 0; p -= p & -p) {
+				distance += fenwick[p];
+			}
+			for (size_t p = prev; p > 0; p -= p & -p) distance -= fenwick[p];
+			at_distance[distance]++;
+			for (size_t p = prev; p <= n_accesses; p += p & -p) fenwick[p]--;
+		} else {
+			cold++;
+		}
+		for (size_t p = position; p <= n_accesses; p += p & -p) fenwick[p]++;
+		last[e->address] = position;
+	}
+
+	printf("\nreuse_distance_below,accesses,cumulative_share\n");
+	for (uint32_t d = 0; d < header->mem_size; ++d) {
+		unsigned bucket = 0;
+		while (bucket < DISTANCE_BUCKETS - 1 && (1ULL << bucket) <= d) {
+			++bucket;
+		}
+		buckets[bucket] += at_distance[d];
+	}
+	for (unsigned b = 0; b < DISTANCE_BUCKETS; ++b) {
+		if (!buckets[b]) continue;
+		cumulative += buckets[b];
+		printf("%llu,%" PRIu64 ",%.4f\n", 1ULL << b, buckets[b],
+			n_accesses ? (double) cumulative / n_accesses : 0.0);
+	}
+	printf("cold,%" PRIu64 ",%.4f\n", cold,
+		n_accesses ? (double) (cumulative + cold) / n_accesses : 0.0);
+
+	printf("\ncache_nodes,hits,hit_rate\n");
+	for (size_t s = 0; s < n_sizes; ++s) {
+		uint64_t hits = 0;
+		for (uint64_t d = 0; d < sizes[s] && d < header->mem_size; ++d) {
+			hits += at_distance[d];
+		}
+		printf("%" PRIu64 ",%" PRIu64 ",%.4f\n", sizes[s], hits,
+			n_accesses ? (double) hits / n_accesses : 0.0);
+	}
+	free(fenwick);
+	free(last);
+	free(at_distance);
+}
+
+
+int main(int argc, char **argv) {
+	uint64_t sizes[64];
+	size_t n_sizes = 0, n_hottest = 10, n_events;
+	char const *size_list = "16,64,256,1024,4096,16384,65536";
+	TraceHeader header;
+	TraceEvent *events;
+	uint64_t threads = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+		switch (opt) {
+		case 'c': size_list = optarg; break;
+		case 'n': n_hottest = strtoul(optarg, NULL, 0); break;
+		default: return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-c sizes] [-n hottest] trace\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (char const *s = size_list; *s && n_sizes < 64;) {
+		char *end;
+		sizes[n_sizes++] = strtoull(s, &end, 0);
+		if (end == s || (*end && *end != ',')) {
+			fprintf(stderr, "Bad cache size list %s\n", size_list);
+			return EXIT_FAILURE;
+		}
+		s = *end ? end + 1 : end;
+	}
+
+	events = read_trace(argv[optind], &header, &n_events);
+	if (!events) return EXIT_FAILURE;
+	if (!sort_events(events, n_events)) {
+		fprintf(stderr, "Out of memory sorting the trace\n");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_events; ++i) {
+		if (events[i].thread >= threads) threads = events[i].thread + 1;
+	}
+	fprintf(stderr, "order=%" PRIu32 " nodes_per_level=%" PRIu32
+		" levels=%" PRIu32 " events=%zu threads=%" PRIu64 " seconds=%.4f\n",
+		header.tree_order, header.nodes_per_level, header.levels, n_events,
+		threads, n_events ? events[n_events - 1].time / 1e9 : 0.0);
+
+	report_heat(&header, events, n_events, n_hottest);
+	report_locks(&header, events, n_events);
+	report_reuse(&header, events, n_events, sizes, n_sizes);
+	free(events);
+	return EXIT_SUCCESS;
+}
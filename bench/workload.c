@@ -0,0 +1,496 @@
+//! @file workload.c
+//! @brief YCSB-style workloads against a single tree configuration
+//!
+//! Bulk loads a tree with evenly spaced keys and then runs a mix of searches,
+//! inserts and short scans from several threads, drawing keys from a uniform,
+//! Zipfian or sequential distribution. Prints one CSV row of throughput and
+//! latency percentiles. The tree geometry is fixed at compile time, so
+//! `bench/sweep.sh` builds one binary per configuration. To build a single
+//! configuration from the repository root against the host memory backend:
+//!
+//!     cc -O2 -march=native -pthread -DATOMIC_LOCKS -DTREE_ORDER=16
+//!         -DMAX_NODES_PER_LEVEL=131072 -DMAX_LEVELS=6 -I.
+//!         bench/workload.c alloc.c bulk-load.c erase.c forest.c insert.c
+//!         insert-helpers.c memory-host.c memory-trace.c node.c node-cache.c
+//!         scan.c search.c split.c stats.c tree-helpers.c -lm -o workload
+//!
+//! Usage: `workload [-w read|write|scan|mixed]
+//!                  [-d uniform|zipfian|sequential] [-t threads]
+//!                  [-n keys] [-o ops per thread] [-s seed] [-H]
+//!                  [-T trace] [-f trees [-P]]`
+//!
+//! `-H` leaves out the CSV header, for appending to an existing file. `-f`
+//! divides the keys evenly among a @ref Forest of that many trees, for which
+//! MEM_REGIONS must be at least as large, and `-P` has thread `t` keep to the
+//! keys of tree `t` modulo the number of trees. Sequential inserts then fill
+//! in the thread's own range rather than extending the tree. Built
+//! with `-DTREE_STATS`, it also prints the tree's internal counters and
+//! per-level occupancy to stderr, and with `-DNODE_CACHE` as well, the node
+//! cache's hit rate and occupancy. Built with `-DMEM_TRACE`, `-T` records the
+//! node accesses made during the run to a file for bench/trace-replay.c.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "bulk-load.h"
+#include "forest.h"
+#include "insert.h"
+#include "memory.h"
+#include "memory-trace.h"
+#include "node-cache.h"
+#include "scan.h"
+#include "search.h"
+#include "stats.h"
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//! @brief Longest range visited by a single scan operation
+#define MAX_SCAN_LENGTH 100
+//! @brief Skew of the Zipfian distribution, as used by YCSB
+#define ZIPF_THETA 0.99
+
+
+//! @brief Percentage of each kind of operation in a workload
+typedef struct {
+	char const *name;
+	unsigned search;
+	unsigned insert;
+	unsigned scan;
+} Mix;
+
+//! @brief The workloads on offer, modelled on YCSB's core workloads
+static Mix const MIXES[] = {
+	// Read mostly, like YCSB B
+	{"read", 95, 5, 0},
+	// Update heavy, like YCSB A, with inserts standing in for updates
+	{"write", 50, 50, 0},
+	// Short ranges, like YCSB E
+	{"scan", 0, 5, 95},
+	{"mixed", 60, 25, 15},
+};
+
+//! @brief How keys are chosen
+typedef enum {UNIFORM, ZIPFIAN, SEQUENTIAL} Distribution;
+static char const *const DISTRIBUTION_NAMES[] = {
+	"uniform", "zipfian", "sequential"
+};
+
+//! @brief Precomputed constants for drawing from a Zipfian distribution
+//!
+//! Follows Gray et al., "Quickly Generating Billion-Record Synthetic
+//! Databases", as YCSB does.
+typedef struct {
+	uint64_t n;
+	double alpha;
+	double zetan;
+	double eta;
+	double half_pow_theta;
+} Zipf;
+
+//! @brief Settings shared by every thread
+typedef struct {
+	Mix const *mix;
+	Distribution distribution;
+	Zipf zipf;
+	size_t n_threads;
+	//! @brief Number of keys loaded before the run
+	size_t n_keys;
+	size_t n_ops;
+	uint64_t seed;
+	bptr_t *root;
+	//! @brief Trees the keys are divided among, or NULL to use the tree at
+	//!        root alone
+	Forest *forest;
+	//! @brief Whether each thread keeps to the keys of one tree of the forest
+	bool owned;
+	pthread_barrier_t start;
+} Config;
+
+//! @brief State and results of a single thread
+typedef struct {
+	Config *config;
+	size_t thread;
+	//! @brief Latency of each operation in nanoseconds
+	uint32_t *latencies;
+	size_t errors;
+#ifdef TREE_STATS
+	OpStats stats;
+#endif
+} Worker;
+
+
+//! @brief Current time in nanoseconds from a monotonic clock
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//! @brief xorshift64* pseudorandom number generator
+static uint64_t next_rand(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//! @brief Uniform double in [0, 1)
+static double next_unit(uint64_t *state) {
+	return (next_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//! @brief 64-bit FNV-1a hash, used to scatter popular Zipfian items
+static uint64_t fnv1a(uint64_t x) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (int i = 0; i < 8; ++i) {
+		hash ^= x & 0xFF;
+		hash *= 0x100000001B3ULL;
+		x >>= 8;
+	}
+	return hash;
+}
+
+//! @brief Set up a Zipfian distribution over n items
+static void zipf_init(Zipf *zipf, uint64_t n) {
+	double zeta2 = 1 + pow(0.5, ZIPF_THETA);
+	zipf->n = n;
+	zipf->zetan = 0;
+	for (uint64_t i = 1; i <= n; ++i) zipf->zetan += pow(i, -ZIPF_THETA);
+	zipf->alpha = 1 / (1 - ZIPF_THETA);
+	zipf->eta = (1 - pow(2.0 / n, 1 - ZIPF_THETA)) / (1 - zeta2 / zipf->zetan);
+	zipf->half_pow_theta = pow(0.5, ZIPF_THETA);
+}
+
+//! @brief Draw an item, with the most popular ones spread over the key space
+static uint64_t zipf_next(Zipf const *zipf, uint64_t *state) {
+	const double u = next_unit(state);
+	const double uz = u * zipf->zetan;
+	uint64_t rank;
+	if (uz < 1) {
+		rank = 0;
+	} else if (uz < 1 + zipf->half_pow_theta) {
+		rank = 1;
+	} else {
+		rank = zipf->n * pow(zipf->eta * u - zipf->eta + 1, zipf->alpha);
+	}
+	return fnv1a(rank) % zipf->n;
+}
+
+//! @brief Count the entries visited by a scan
+static bool count_entry(bkey_t key, bval_t value, void *ctx) {
+	(void) key;
+	(void) value;
+	(*(size_t *) ctx)++;
+	return true;
+}
+
+#ifdef TREE_STATS
+//! @brief Print the counters gathered across all threads and the state of
+//!        the memory grid
+static void print_stats(Worker const *workers, size_t n_threads) {
+	OpStats total = {0};
+	LevelStats levels[MAX_LEVELS];
+
+	for (size_t t = 0; t < n_threads; ++t) {
+		op_stats_merge(&total, &workers[t].stats);
+	}
+	fprintf(stderr,
+		"node_reads=%" PRIu64 " node_writes=%" PRIu64
+		" read_retries=%" PRIu64 " lock_acquires=%" PRIu64
+		" lock_spins=%" PRIu64 " right_moves=%" PRIu64
+		" restarts=%" PRIu64 " shifts=%" PRIu64 " parent_full=%" PRIu64
+		" root_splits=%" PRIu64 "\n",
+		total.node_reads, total.node_writes, total.read_retries,
+		total.lock_acquires, total.lock_spins, total.right_moves,
+		total.restarts, total.shifts, total.parent_full, total.root_splits);
+	tree_stats(levels);
+	for (uint_fast8_t i = 0; i < MAX_LEVELS; ++i) {
+		fprintf(stderr, "level=%u splits=%" PRIu64 " nodes=%" PRIu32
+			" free=%" PRIu32 " keys=%" PRIu64 " fill=%.3f\n",
+			(unsigned) i, total.splits[i], levels[i].nodes, levels[i].free,
+			levels[i].keys, levels[i].fill);
+	}
+#ifdef NODE_CACHE
+	NodeCacheStats cache;
+	node_cache_stats(&cache);
+	fprintf(stderr, "cache_hits=%" PRIu64 " cache_misses=%" PRIu64
+		" hit_rate=%.3f capacity=%" PRIu32 " used=%" PRIu32
+		" pinned=%" PRIu32 "\n",
+		total.cache_hits, total.cache_misses,
+		(total.cache_hits + total.cache_misses)
+			? (double) total.cache_hits
+				/ (total.cache_hits + total.cache_misses)
+			: 0.0,
+		cache.capacity, cache.used, cache.pinned);
+#endif
+}
+#endif
+
+//! @brief Compare latencies for sorting
+static int compare_latency(void const *a, void const *b) {
+	const uint32_t x = *(uint32_t const *) a;
+	const uint32_t y = *(uint32_t const *) b;
+	return (x > y) - (x < y);
+}
+
+
+//! @brief Body of a worker thread
+static void *run(void *arg) {
+	Worker *w = arg;
+	Config const *c = w->config;
+	uint64_t rng = c->seed ^ (0x9E3779B97F4A7C15ULL * (w->thread + 1));
+	// Sequential reads walk their own slice of the loaded keys
+	size_t cursor = w->thread * (c->n_keys / c->n_threads);
+
+	pthread_barrier_wait(&w->config->start);
+#ifdef TREE_STATS
+	op_stats_reset();
+#endif
+	for (size_t j = 0; j < c->n_ops; ++j) {
+		const unsigned roll = next_rand(&rng) % 100;
+		size_t index;
+		uint64_t start;
+		ErrorCode status;
+
+		switch (c->distribution) {
+		case UNIFORM:
+			index = next_rand(&rng) % c->n_keys;
+			break;
+		case ZIPFIAN:
+			index = zipf_next(&c->zipf, &rng);
+			break;
+		default:
+			index = cursor++ % c->n_keys;
+			break;
+		}
+		if (c->owned) {
+			// The loaded keys are divided evenly among the trees
+			const size_t tree = w->thread % c->forest->n_trees;
+			const size_t first = c->n_keys * tree / c->forest->n_trees;
+			const size_t end = c->n_keys * (tree + 1) / c->forest->n_trees;
+			index = first + index % (end - first);
+		}
+
+		start = now_ns();
+		if (roll < c->mix->search) {
+			// Loaded keys are even
+			const bstatusval_t result = c->forest
+				? forest_search(c->forest, 2*index)
+				: search(*c->root, 2*index);
+			status = result.status;
+		} else if (roll < c->mix->search + c->mix->insert) {
+			// Inserted keys are odd, or past the loaded range if sequential
+			const bkey_t key = (c->distribution == SEQUENTIAL && !c->owned)
+				? 2*(c->n_keys + j*c->n_threads + w->thread)
+				: 2*index + 1;
+			const bval_t value = {.data = key};
+			status = c->forest
+				? forest_insert(c->forest, key, value)
+				: insert(c->root, key, value);
+			if (status == KEY_EXISTS) status = SUCCESS;
+		} else {
+			ScanCursor scan_cursor;
+			size_t visited = 0;
+			const size_t length = 1 + next_rand(&rng) % MAX_SCAN_LENGTH;
+			scan_init(&scan_cursor, 2*index, INVALID);
+			status = c->forest
+				? forest_scan(c->forest, &scan_cursor, length,
+					count_entry, &visited, NULL)
+				: scan(*c->root, &scan_cursor, length,
+					count_entry, &visited, NULL);
+		}
+		w->latencies[j] = now_ns() - start;
+		if (status != SUCCESS) w->errors++;
+	}
+#ifdef TREE_STATS
+	w->stats = thread_stats;
+#endif
+	return NULL;
+}
+
+
+int main(int argc, char **argv) {
+	Config config = {
+		.mix = &MIXES[0],
+		.distribution = UNIFORM,
+		.n_threads = 1,
+		.n_keys = 200000,
+		.n_ops = 100000,
+		.seed = 88172645463325252ULL,
+	};
+	bool header = true;
+	char const *trace = NULL;
+	size_t n_trees = 0;
+	Forest forest;
+	bkey_t *keys;
+	bval_t *values;
+	pthread_t *threads;
+	Worker *workers;
+	uint32_t *latencies;
+	size_t n_total, errors = 0;
+	bptr_t root = 0;
+	uint64_t elapsed;
+	ErrorCode status;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:d:t:n:o:s:HT:f:P")) != -1) {
+		switch (opt) {
+		case 'w':
+			config.mix = NULL;
+			for (size_t i = 0; i < sizeof(MIXES)/sizeof(MIXES[0]); ++i) {
+				if (!strcmp(optarg, MIXES[i].name)) config.mix = &MIXES[i];
+			}
+			if (!config.mix) {
+				fprintf(stderr, "Unknown workload %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			if (!strcmp(optarg, "uniform")) config.distribution = UNIFORM;
+			else if (!strcmp(optarg, "zipfian")) config.distribution = ZIPFIAN;
+			else if (!strcmp(optarg, "sequential")) {
+				config.distribution = SEQUENTIAL;
+			} else {
+				fprintf(stderr, "Unknown distribution %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't': config.n_threads = strtoul(optarg, NULL, 0); break;
+		case 'n': config.n_keys = strtoul(optarg, NULL, 0); break;
+		case 'o': config.n_ops = strtoul(optarg, NULL, 0); break;
+		case 's': config.seed = strtoull(optarg, NULL, 0); break;
+		case 'H': header = false; break;
+		case 'T': trace = optarg; break;
+		case 'f': n_trees = strtoul(optarg, NULL, 0); break;
+		case 'P': config.owned = true; break;
+		default: return EXIT_FAILURE;
+		}
+	}
+	if (config.n_threads == 0 || config.n_keys == 0 || config.n_ops == 0) {
+		fprintf(stderr, "Threads, keys and operations must be nonzero\n");
+		return EXIT_FAILURE;
+	}
+	if (config.owned && n_trees == 0) {
+		fprintf(stderr, "Threads can only keep to their own trees with -f\n");
+		return EXIT_FAILURE;
+	}
+	if (n_trees > config.n_keys) {
+		fprintf(stderr, "Every tree needs some of the keys\n");
+		return EXIT_FAILURE;
+	}
+#ifndef MEM_TRACE
+	if (trace) {
+		fprintf(stderr, "Tracing needs a build with -DMEM_TRACE\n");
+		return EXIT_FAILURE;
+	}
+#endif
+
+	n_total = config.n_threads * config.n_ops;
+	keys = malloc(config.n_keys * sizeof(bkey_t));
+	values = malloc(config.n_keys * sizeof(bval_t));
+	threads = malloc(config.n_threads * sizeof(pthread_t));
+	workers = malloc(config.n_threads * sizeof(Worker));
+	latencies = malloc(n_total * sizeof(uint32_t));
+	if (!keys || !values || !threads || !workers || !latencies) {
+		fprintf(stderr, "Allocation failed\n");
+		return EXIT_FAILURE;
+	}
+
+	// Leave some room in the leaves so that inserts do not all split
+	for (size_t i = 0; i < config.n_keys; ++i) {
+		keys[i] = 2*i;
+		values[i].data = 2*i;
+	}
+	mem_reset_all();
+	if (n_trees) {
+		bkey_t bounds[MEM_REGIONS];
+		for (size_t i = 1; i < n_trees && i <= MEM_REGIONS; ++i) {
+			bounds[i-1] = keys[config.n_keys * i / n_trees];
+		}
+		status = forest_init(&forest, n_trees, bounds);
+		if (status != SUCCESS) {
+			fprintf(stderr, "Setting up %zu trees failed: %s\n", n_trees,
+				ERROR_CODE_NAMES[status]);
+			return EXIT_FAILURE;
+		}
+		status = forest_bulk_load(&forest, keys, values, config.n_keys,
+			(3*TREE_ORDER + 3) / 4);
+		config.forest = &forest;
+	} else {
+		status = bulk_load(&root, keys, values, config.n_keys,
+			(3*TREE_ORDER + 3) / 4);
+	}
+	if (status != SUCCESS) {
+		fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+		return EXIT_FAILURE;
+	}
+	free(keys);
+	free(values);
+	config.root = &root;
+	if (config.distribution == ZIPFIAN) zipf_init(&config.zipf, config.n_keys);
+
+	pthread_barrier_init(&config.start, NULL, config.n_threads + 1);
+	for (size_t t = 0; t < config.n_threads; ++t) {
+		workers[t] = (Worker){
+			.config = &config,
+			.thread = t,
+			.latencies = latencies + t*config.n_ops,
+			.errors = 0,
+		};
+		pthread_create(&threads[t], NULL, run, &workers[t]);
+	}
+#ifdef MEM_TRACE
+	// Leave out the load, since the workers are held at the barrier
+	if (trace && (status = mem_trace_open(trace)) != SUCCESS) {
+		fprintf(stderr, "Opening %s failed: %s\n", trace,
+			ERROR_CODE_NAMES[status]);
+		return EXIT_FAILURE;
+	}
+#endif
+	elapsed = now_ns();
+	pthread_barrier_wait(&config.start);
+	for (size_t t = 0; t < config.n_threads; ++t) {
+		pthread_join(threads[t], NULL);
+		errors += workers[t].errors;
+	}
+	elapsed = now_ns() - elapsed;
+	pthread_barrier_destroy(&config.start);
+#ifdef MEM_TRACE
+	if (trace && (status = mem_trace_close()) != SUCCESS) {
+		fprintf(stderr, "Writing %s failed: %s\n", trace,
+			ERROR_CODE_NAMES[status]);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	qsort(latencies, n_total, sizeof(uint32_t), compare_latency);
+	if (header) {
+		printf("order,nodes_per_level,levels,workload,distribution,threads,"
+			"trees,owned,keys,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,"
+			"errors\n");
+	}
+	printf("%d,%d,%d,%s,%s,%zu,%zu,%d,%zu,%zu,%.4f,%.0f,%u,%u,%u,%zu\n",
+		TREE_ORDER, MAX_NODES_PER_LEVEL, MAX_LEVELS,
+		config.mix->name, DISTRIBUTION_NAMES[config.distribution],
+		config.n_threads, n_trees ? n_trees : 1, config.owned,
+		config.n_keys, n_total, elapsed / 1e9,
+		n_total / (elapsed / 1e9),
+		latencies[n_total / 2],
+		latencies[n_total * 99 / 100],
+		latencies[n_total * 999 / 1000],
+		errors);
+
+#ifdef TREE_STATS
+	print_stats(workers, config.n_threads);
+#endif
+	free(threads);
+	free(workers);
+	free(latencies);
+	return EXIT_SUCCESS;
+}
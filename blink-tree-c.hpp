@@ -0,0 +1,109 @@
+#ifndef BLINK_TREE_C_HPP
+#define BLINK_TREE_C_HPP
+
+//! @file blink-tree-c.hpp
+//! @brief The C tree as an instantiation of @ref blink::BLinkTree
+//!
+//! @ref blink::CMemory adapts whichever C memory backend and allocator the
+//! program is linked with to the template, so that @ref blink::CTree shares
+//! its nodes, with the same keys, values, order and geometry, with the C API.
+//! A tree built through either can be read and extended through the other,
+//! given the root address: pass the C root to @ref blink::BLinkTree::attach,
+//! and pass @ref blink::BLinkTree::root back to the C functions. The two must
+//! not work on the tree at the same time, since each keeps its own copy of
+//! the root. The C sources themselves stay C for the HLS flow.
+//!
+//! @ref blink::CTree always splits nodes in half and ignores
+//! APPEND_SPLIT_KEEP, so keys appended past the end of a level through it
+//! leave the nodes behind half full, where the C API leaves them nearly
+//! full. A tree continued through the other API keeps the same contents but
+//! takes on that API's fill.
+
+
+// Pulled in ahead of the C headers so that they are not seen as C
+#include <atomic>
+#include "blink-tree.hpp"
+
+extern "C" {
+#include "alloc.h"
+#include "memory.h"
+#include "node.h"
+}
+
+
+namespace blink {
+
+
+//! @brief Memory backend forwarding to @ref memory.h and @ref alloc.h
+//!
+//! Memory is shared by the whole program, so it is reset through
+//! @ref mem_reset_all rather than by this class.
+struct CMemory {
+	using node_type = Node<bkey_t, bdata_t, TREE_ORDER, bptr_t>;
+	using ptr_type = bptr_t;
+	using version_type = bver_t;
+
+	static_assert(node_type::invalid_key == INVALID
+			&& node_type::invalid_ptr == INVALID,
+		"Both trees must mark unused slots the same way");
+	static_assert(sizeof(node_type::Entry) == sizeof(bval_t),
+		"Entries must match bval_t");
+	static_assert(offsetof(::AddrNode, addr) == sizeof(::Node),
+		"Nodes must be laid out as in C");
+
+	ptr_type root() const { return 0; }
+
+	node_type read(ptr_type addr) const { return convert(mem_read(addr)); }
+
+	node_type read_versioned(ptr_type addr, version_type &version) const {
+		return convert(mem_read_versioned(addr, &version));
+	}
+
+	bool validate(ptr_type addr, version_type version) const {
+		return mem_validate(addr, version);
+	}
+
+	node_type read_lock(ptr_type addr) { return convert(mem_read_lock(addr)); }
+
+	void write_unlock(ptr_type addr, node_type const &node) {
+		AddrNode out;
+		out.addr = addr;
+		std::memcpy(out.node.keys, node.keys, sizeof(node.keys));
+		std::memcpy(out.node.values, node.values, sizeof(node.values));
+		out.node.next = node.next;
+		out.node.low_key = node.low_key;
+		out.node.high_key = node.high_key;
+		set_level(&out.node, get_level(addr));
+		mem_write_unlock(&out);
+	}
+
+	void unlock(ptr_type addr) { mem_unlock(addr); }
+
+	// Nodes go in region 0, where the C API's plain trees live
+	ptr_type alloc(unsigned level) { return alloc_slot(level, 0); }
+
+	void free(ptr_type addr) { free_slot(addr); }
+
+	unsigned level(ptr_type addr) const { return get_level(addr); }
+
+private:
+	static node_type convert(::Node const &in) {
+		node_type out;
+		std::memcpy(out.keys, in.keys, sizeof(out.keys));
+		std::memcpy(out.values, in.values, sizeof(out.values));
+		out.next = in.next;
+		out.low_key = in.low_key;
+		out.high_key = in.high_key;
+		return out;
+	}
+};
+
+
+//! @brief The tree the C API operates on
+using CTree = BLinkTree<bkey_t, bdata_t, TREE_ORDER, CMemory>;
+
+
+} // namespace blink
+
+
+#endif
@@ -0,0 +1,805 @@
+#ifndef BLINK_TREE_HPP
+#define BLINK_TREE_HPP
+
+//! @file blink-tree.hpp
+//! @brief Header-only C++ version of the tree, generic over its key and value
+//!        types, order and memory backend
+//!
+//! Follows the same algorithms as node.c, insert.c, split.c, search.c and
+//! tree-helpers.c: optimistic lock-free descents validated with per-node
+//! versions, right links and high keys to survive concurrent splits, and
+//! inserts which lock only the leaf unless it has to split. Since the order
+//! is known at compile time, the key search in each node, the shifting of
+//! entries in @ref blink::Node::insert_nonfull and the copy of entries into a
+//! split node's sibling are fully unrolled. Any number of differently
+//! configured trees can live in one process, each in its own memory.
+//!
+//! Needs C++17. Erasing and range scans are so far only available from C.
+//! See blink-tree-c.hpp for the instantiation over the C memory backends, and
+//! string-node.hpp for nodes holding variable-length string keys.
+
+
+#include "lock.h"
+#include "types.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+namespace blink {
+
+
+//! @brief Call a function once with each index below N, as a compile-time
+//!        constant, with no loop left at runtime
+template <typename F, std::size_t... I>
+constexpr void unroll(F &&f, std::index_sequence<I...>) {
+	(f(std::integral_constant<std::size_t, I>{}), ...);
+}
+
+template <std::size_t N, typename F>
+constexpr void unroll(F &&f) {
+	unroll(std::forward<F>(f), std::make_index_sequence<N>{});
+}
+
+
+//! @brief A generic node within the tree, the counterpart of struct Node
+//!
+//! Can be a leaf node or an inner node. The largest key value marks unused
+//! slots, so it can not be stored in the tree.
+template <typename Key, typename Value, std::size_t Order,
+	typename Ptr = std::uint32_t>
+struct Node {
+	static_assert(Order >= 2 && Order % 2 == 0,
+		"Nodes split in half, so the order must be even");
+	static_assert(std::numeric_limits<Key>::is_specialized,
+		"Keys need a largest value to mark unused slots");
+	static_assert(std::is_trivially_copyable_v<Value>
+			&& std::is_trivially_default_constructible_v<Value>,
+		"Values are copied as raw memory");
+
+	using key_type = Key;
+	//! @brief How keys are passed in, which for other node types may refer
+	//!        to a key stored elsewhere
+	using key_view = Key;
+	using value_type = Value;
+	using ptr_type = Ptr;
+	static constexpr std::size_t order = Order;
+	static constexpr Key invalid_key = std::numeric_limits<Key>::max();
+	static constexpr Ptr invalid_ptr = std::numeric_limits<Ptr>::max();
+
+	//! @brief Address of a child in inner nodes, or data in leaves, like
+	//!        @ref bval_t
+	union Entry {
+		Ptr ptr;
+		Value data;
+	};
+
+	//! @brief Keys in increasing order, followed by unused slots
+	Key keys[Order];
+	//! @brief The entries corresponding to the keys at the same indices
+	Entry values[Order];
+	//! @brief Address of the next node on the same level
+	Ptr next;
+	//! @brief Exclusive lower bound on the keys held in or beneath this node
+	Key low_key;
+	//! @brief Upper bound on the keys held in or beneath this node
+	Key high_key;
+
+	//! @brief Number of keys less than the given key, equivalently the index
+	//!        of the first key greater than or equal to it
+	std::size_t rank(Key key) const {
+		std::size_t i = 0;
+		unroll<Order>([&](auto j) { i += keys[j] < key; });
+		return i;
+	}
+
+	bool is_valid() const { return keys[0] != invalid_key; }
+	bool is_full() const { return keys[Order-1] != invalid_key; }
+	std::size_t num_keys() const { return rank(invalid_key); }
+
+	//! @brief Whether a key can be stored in the tree at all
+	static bool storable(Key key) { return key != invalid_key; }
+
+	//! @brief Whether @ref insert_nonfull has room for a key
+	bool has_room(Key) const { return !is_full(); }
+
+	Key key_at(std::size_t i) const { return keys[i]; }
+
+	//! @brief The largest valid key, or the first slot's if there are none
+	Key max() const {
+		const std::size_t n = num_keys();
+		return keys[n ? n-1 : 0];
+	}
+
+	//! @brief See @ref past_high_key
+	bool past_high_key(Key key) const {
+		return key > high_key && next != invalid_ptr;
+	}
+
+	//! @brief See @ref before_low_key
+	bool before_low_key(Key key) const {
+		return low_key != invalid_key && key <= low_key;
+	}
+
+	//! @brief Empty this node's contents and restore its default state
+	void clear() {
+		unroll<Order>([&](auto j) { keys[j] = invalid_key; });
+		low_key = invalid_key;
+		high_key = invalid_key;
+	}
+
+	//! @brief See @ref find_next
+	//! @param[in]  key   The key to search for
+	//! @param[out] addr  The next node to check on success
+	ErrorCode find_next(Key key, Ptr &addr) const {
+		if (past_high_key(key)) {
+			addr = next;
+			return SUCCESS;
+		}
+		const std::size_t i = rank(key);
+		if (i < Order) {
+			if (keys[i] != invalid_key) {
+				addr = values[i].ptr;
+			} else if (i == 0) {
+				return NOT_FOUND;
+			} else {
+				addr = values[i-1].ptr;
+			}
+		} else {
+			addr = (next == invalid_ptr) ? values[Order-1].ptr : next;
+		}
+		return SUCCESS;
+	}
+
+	//! @brief See @ref find_value
+	ErrorCode find_value(Key key, Value &value) const {
+		std::size_t found = Order;
+		unroll<Order>([&](auto j) { if (keys[j] == key) found = j; });
+		if (found == Order) return NOT_FOUND;
+		value = values[found].data;
+		return SUCCESS;
+	}
+
+	//! @brief See @ref find_child
+	std::size_t find_child(Ptr child) const {
+		for (std::size_t i = 0; i < Order && keys[i] != invalid_key; ++i) {
+			if (values[i].ptr == child) return i;
+		}
+		return Order;
+	}
+
+	//! @brief Insert into a node which is not full, keeping keys in order
+	ErrorCode insert_nonfull(Key key, Entry value) {
+		const std::size_t at = rank(key);
+		if (at < Order && keys[at] == key) return KEY_EXISTS;
+		if (is_full()) return OUT_OF_MEMORY;
+		// Scoot everything from the insertion point over by one
+		unroll<Order-1>([&](auto r) {
+			constexpr std::size_t j = Order - 1 - r;
+			if (j > at) {
+				keys[j] = keys[j-1];
+				values[j] = values[j-1];
+			}
+		});
+		keys[at] = key;
+		values[at] = value;
+		return SUCCESS;
+	}
+
+	//! @brief Replace a key without changing its corresponding value
+	ErrorCode rekey(Key old_key, Key new_key) {
+		for (std::size_t i = 0; i < Order; ++i) {
+			if (keys[i] == old_key) {
+				keys[i] = new_key;
+				return SUCCESS;
+			}
+		}
+		return NOT_FOUND;
+	}
+
+	//! @brief Replace the key at an index without changing its value
+	void rekey_at(std::size_t i, Key key) { keys[i] = key; }
+
+	//! @brief Move the upper half of a full node into an empty sibling
+	//!
+	//! The sibling inherits this node's range above the split point. Right
+	//! links are left to the caller.
+	//! @param[in] leaf  Whether the node is a leaf, which only matters to node
+	//!                  types that can shorten separators there
+	//! @return The separator, now this node's high key
+	Key split(Node &sibling, bool leaf) {
+		constexpr std::size_t half = Order / 2;
+		(void) leaf;
+		unroll<half>([&](auto i) {
+			sibling.keys[i] = keys[i + half];
+			sibling.values[i] = values[i + half];
+			keys[i + half] = invalid_key;
+		});
+		sibling.high_key = high_key;
+		high_key = keys[half-1];
+		sibling.low_key = high_key;
+		return high_key;
+	}
+
+	//! @brief Become a root over two children, bounding nothing
+	void make_root(Key left_key, Ptr left, Key right_key, Ptr right) {
+		clear();
+		next = invalid_ptr;
+		keys[0] = left_key;
+		values[0].ptr = left;
+		keys[1] = right_key;
+		values[1].ptr = right;
+	}
+
+	//! @brief Record that the child at an index has split
+	//! @param[in] i            Index of the child which split
+	//! @param[in] left_key     The child's new upper bound
+	//! @param[in] sibling_key  Upper bound of the child's new sibling
+	//! @param[in] sibling      Address of the new sibling
+	//! @return PARENT_FULL if there is no room, otherwise SUCCESS
+	ErrorCode add_split_child(
+		std::size_t i, Key left_key, Key sibling_key, Ptr sibling
+	) {
+		if (is_full()) return PARENT_FULL;
+		keys[i] = left_key;
+		for (std::size_t j = Order-1; j > i; --j) {
+			keys[j] = keys[j-1];
+			values[j] = values[j-1];
+		}
+		keys[i+1] = sibling_key;
+		values[i+1].ptr = sibling;
+		return SUCCESS;
+	}
+};
+
+
+//! @brief Memory backend holding a tree's nodes on the host heap
+//!
+//! Plays the part of memory-host.c and alloc.c for one tree. Every slot
+//! carries its own lock, seqlock version and level, and a slot may be handed
+//! to any level, so the tree's shape is limited only by the total capacity.
+//! Other backends must provide the same members.
+template <typename NodeT, std::size_t Capacity>
+class HostMemory {
+public:
+	using node_type = NodeT;
+	using ptr_type = typename NodeT::ptr_type;
+	using version_type = std::uint32_t;
+
+	static_assert(Capacity > 0 && Capacity < NodeT::invalid_ptr,
+		"Every slot needs an address");
+
+	HostMemory() :
+		slots(new Slot[Capacity]), used(new std::atomic<std::uint64_t>[WORDS]) {
+		reset();
+	}
+
+	//! @brief Empty every slot, leaving an empty root leaf at address 0
+	//!
+	//! Must not run concurrently with anything else
+	void reset() {
+		for (std::size_t i = 0; i < Capacity; ++i) {
+			slots[i].node.clear();
+			slots[i].node.next = NodeT::invalid_ptr;
+			slots[i].version.store(0, std::memory_order_relaxed);
+			slots[i].lock.store(false, std::memory_order_relaxed);
+			slots[i].level.store(0, std::memory_order_relaxed);
+		}
+		for (std::size_t w = 0; w < WORDS; ++w) {
+			used[w].store(0, std::memory_order_relaxed);
+		}
+		// The root never goes back to the allocator
+		used[0].store(1, std::memory_order_relaxed);
+		hint.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	//! @brief Address of the root of an empty tree
+	ptr_type root() const { return 0; }
+
+	//! @brief See @ref mem_read
+	NodeT read(ptr_type addr) const {
+		version_type version;
+		return read_versioned(addr, version);
+	}
+
+	//! @brief See @ref mem_read_versioned
+	NodeT read_versioned(ptr_type addr, version_type &version) const {
+		Slot const &slot = slots[addr];
+		NodeT node;
+		for (;;) {
+			version = slot.version.load(std::memory_order_acquire);
+			if (version & 1) {
+				cpu_relax();
+				continue;
+			}
+			std::memcpy(&node, &slot.node, sizeof(NodeT));
+			// Retry if a writer started while the node was being copied
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.version.load(std::memory_order_relaxed) == version) {
+				return node;
+			}
+		}
+	}
+
+	//! @brief See @ref mem_validate
+	bool validate(ptr_type addr, version_type version) const {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slots[addr].version.load(std::memory_order_relaxed) == version
+			&& !slots[addr].lock.load(std::memory_order_relaxed);
+	}
+
+	//! @brief See @ref mem_read_lock
+	NodeT read_lock(ptr_type addr) {
+		Slot &slot = slots[addr];
+		NodeT node;
+		for (unsigned backoff = 1;
+			slot.lock.exchange(true, std::memory_order_acquire);) {
+			for (unsigned i = 0; i < backoff; ++i) cpu_relax();
+			if (backoff < LOCK_MAX_BACKOFF) backoff <<= 1;
+		}
+		std::memcpy(&node, &slot.node, sizeof(NodeT));
+		return node;
+	}
+
+	//! @brief See @ref mem_write_unlock
+	void write_unlock(ptr_type addr, NodeT const &node) {
+		Slot &slot = slots[addr];
+		const version_type old = slot.version.load(std::memory_order_relaxed);
+		// Mark the node as mid-write for the duration of the copy
+		slot.version.store(old + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&slot.node, &node, sizeof(NodeT));
+		slot.version.store(old + 2, std::memory_order_release);
+		unlock(addr);
+	}
+
+	//! @brief See @ref mem_unlock
+	void unlock(ptr_type addr) {
+		slots[addr].lock.store(false, std::memory_order_release);
+	}
+
+	//! @brief See @ref alloc_slot
+	ptr_type alloc(unsigned level) {
+		const std::size_t start = hint.load(std::memory_order_relaxed);
+		for (std::size_t n = 0; n < WORDS; ++n) {
+			const std::size_t w = (start + n) % WORDS;
+			std::uint64_t free_bits = ~used[w].load(std::memory_order_relaxed)
+				& valid_bits(w);
+			while (free_bits) {
+				const std::uint64_t bit = free_bits & -free_bits;
+				// Someone else may claim the same bit first
+				if (!(used[w].fetch_or(bit) & bit)) {
+					const ptr_type addr = w * 64 + __builtin_ctzll(bit);
+					hint.store(w, std::memory_order_relaxed);
+					slots[addr].level.store(level, std::memory_order_relaxed);
+					return addr;
+				}
+				free_bits = ~used[w].load(std::memory_order_relaxed)
+					& valid_bits(w);
+			}
+		}
+		return NodeT::invalid_ptr;
+	}
+
+	//! @brief See @ref free_slot
+	void free(ptr_type addr) {
+		used[addr / 64].fetch_and(~(std::uint64_t{1} << (addr % 64)));
+	}
+
+	//! @brief Level of the tree a slot was last handed to, the leaves being 0
+	unsigned level(ptr_type addr) const {
+		return slots[addr].level.load(std::memory_order_relaxed);
+	}
+
+	//! @brief Number of slots handed out, including the root
+	std::size_t in_use() const {
+		std::size_t n = 0;
+		for (std::size_t w = 0; w < WORDS; ++w) {
+			n += __builtin_popcountll(used[w].load(std::memory_order_relaxed));
+		}
+		return n;
+	}
+
+private:
+	static constexpr std::size_t WORDS = (Capacity + 63) / 64;
+
+	//! @brief Mask of bits in a bitmap word which correspond to real slots
+	static constexpr std::uint64_t valid_bits(std::size_t w) {
+		const std::size_t remaining = Capacity - w * 64;
+		return (remaining >= 64) ? ~std::uint64_t{0}
+			: ((std::uint64_t{1} << remaining) - 1);
+	}
+
+	struct Slot {
+		NodeT node;
+		//! @brief Seqlock counter, odd while the node is being written
+		std::atomic<version_type> version;
+		//! @brief A flag rather than std::atomic_flag, which can not be read
+		//!        without being set before C++20
+		std::atomic<bool> lock;
+		std::atomic<std::uint8_t> level;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	//! @brief Set bits mark slots which are in use
+	std::unique_ptr<std::atomic<std::uint64_t>[]> used;
+	//! @brief Word at which the next allocation's search starts
+	std::atomic<std::size_t> hint;
+};
+
+
+//! @brief A concurrent B-link tree
+//!
+//! Any number of threads may search and insert at once. The tree only goes
+//! through the node's members, so other node types such as
+//! @ref blink::StringNode can stand in for @ref blink::Node.
+//! @tparam Key     Key type stored by the nodes, an integer for @ref Node
+//! @tparam Value   Trivially copyable data stored in the leaves
+//! @tparam Order   Number of entries in each node, which must be even
+//! @tparam Memory  Backend holding the nodes, such as @ref HostMemory
+template <typename Key, typename Value, std::size_t Order,
+	typename Memory = HostMemory<Node<Key, Value, Order>, (1 << 20)>>
+class BLinkTree {
+public:
+	using node_type = typename Memory::node_type;
+	using ptr_type = typename node_type::ptr_type;
+	using version_type = typename Memory::version_type;
+	using entry_type = typename node_type::Entry;
+	using key_view = typename node_type::key_view;
+
+	static_assert(std::is_same_v<typename node_type::key_type, Key>
+			&& std::is_same_v<typename node_type::value_type, Value>
+			&& node_type::order == Order,
+		"The memory backend must hold this tree's nodes");
+
+	//! @brief Longest path from the root, more than enough for trees whose
+	//!        nodes have at least two children each
+	static constexpr std::size_t max_height = 8 * sizeof(ptr_type);
+
+	template <typename... Args>
+	explicit BLinkTree(Args &&...args) :
+		memory_(std::forward<Args>(args)...), root_(memory_.root()) {}
+
+	Memory &memory() { return memory_; }
+	ptr_type root() const { return root_.load(std::memory_order_acquire); }
+
+	//! @brief Take over a tree already in the memory, such as one built
+	//!        through the C API over the same nodes
+	//!
+	//! Must not run concurrently with anything else. The tree's root may
+	//! change as it grows, so read it back through @ref root before going
+	//! on through the other API.
+	//! @param[in] root  Address of the tree's root
+	void attach(ptr_type root) {
+		root_.store(root, std::memory_order_release);
+	}
+
+	//! @brief Search the tree for a key, as @ref search does
+	//! @param[in]  key    The key to search for
+	//! @param[out] value  The key's value, if found
+	//! @return An error code representing the success or type of failure of
+	//!         the operation
+	ErrorCode search(key_view key, Value &value) const {
+		Located n;
+		ptr_type parent, next;
+		version_type version, parent_version{};
+		bool valid;
+		ErrorCode status;
+
+		do {
+			n.addr = root();
+			parent = node_type::invalid_ptr;
+			valid = true;
+			while (valid) {
+				n.node = memory_.read_versioned(n.addr, version);
+				valid = parent == node_type::invalid_ptr
+					|| memory_.validate(parent, parent_version);
+				if (!valid) {
+					STATS_INC(restarts);
+					break;
+				}
+				if (is_leaf(n.addr) && !n.node.past_high_key(key)) break;
+				status = n.node.find_next(key, next);
+				if (status != SUCCESS) return status;
+				parent = n.addr;
+				parent_version = version;
+				n.addr = next;
+			}
+		} while (!valid);
+
+		return n.node.find_value(key, value);
+	}
+
+	//! @brief Insert a new key and value, as @ref insert does
+	//! @return An error code representing the success or type of failure of
+	//!         the operation
+	ErrorCode insert(key_view key, Value value) {
+		ErrorCode status;
+		Located leaf, parent, sibling;
+		ptr_type lineage[max_height];
+		entry_type entry;
+		Key separator, bound;
+		Value existing;
+		bool keep_splitting = false;
+
+		if (!node_type::storable(key)) return INVALID_ARGUMENT;
+		entry.data = value;
+		std::fill(lineage, lineage + max_height, node_type::invalid_ptr);
+		do {
+			status = trace_lineage(key, lineage);
+			if (status != SUCCESS) return status;
+			leaf.addr = lineage[leaf_index(lineage)];
+			leaf.node = memory_.read_lock(leaf.addr);
+			// The leaf may have changed since its parent was read
+		} while (!move_right(leaf, key));
+
+		// Common case, only the leaf needs to be locked
+		if (leaf.node.has_room(key)) {
+			status = leaf.node.insert_nonfull(key, entry);
+			memory_.write_unlock(leaf.addr, leaf.node);
+			return status;
+		}
+		// Not worth splitting for
+		if (leaf.node.find_value(key, existing) == SUCCESS) {
+			memory_.unlock(leaf.addr);
+			return KEY_EXISTS;
+		}
+
+		do {
+			// The node is full, so lock its parent to split it
+			status = lock_parent(lineage, leaf, parent);
+			if (status != SUCCESS) {
+				memory_.unlock(leaf.addr);
+				return status;
+			}
+
+			const bool new_root = (parent.addr == node_type::invalid_ptr);
+			status = split_node(leaf, parent, sibling, separator);
+			keep_splitting = (status == PARENT_FULL);
+			if (keep_splitting) STATS_INC(parent_full);
+			// Unrecoverable failure, nothing has been written
+			if (status != SUCCESS && status != PARENT_FULL) {
+				memory_.unlock(leaf.addr);
+				if (parent.addr != node_type::invalid_ptr) {
+					memory_.unlock(parent.addr);
+				}
+				return status;
+			}
+			status = leaf.node.past_high_key(key)
+				? sibling.node.insert_nonfull(key, entry)
+				: leaf.node.insert_nonfull(key, entry);
+			// Publish the sibling before anything links to it, and the parent
+			// before the split node stops covering the sibling's keys
+			memory_.write_unlock(sibling.addr, sibling.node);
+			if (!keep_splitting) {
+				memory_.write_unlock(parent.addr, parent.node);
+				if (new_root) root_.store(parent.addr, std::memory_order_release);
+			}
+			memory_.write_unlock(leaf.addr, leaf.node);
+			if (keep_splitting) {
+				// Try this again on the parent, where the sibling takes over
+				// the old node's upper bound
+				const std::size_t i = parent.node.find_child(leaf.addr);
+				bound = sibling.node.max();
+				if (parent.node.key_at(i) > bound) bound = parent.node.key_at(i);
+				parent.node.rekey_at(i, separator);
+				key = bound;
+				entry.ptr = sibling.addr;
+				leaf = parent;
+			} else if (status != SUCCESS) {
+				return status;
+			}
+		} while (keep_splitting);
+
+		return SUCCESS;
+	}
+
+private:
+	//! @brief A node along with the address where it resides, like AddrNode
+	struct Located {
+		node_type node;
+		ptr_type addr;
+	};
+
+	bool is_leaf(ptr_type addr) const { return memory_.level(addr) == 0; }
+
+	//! @brief See @ref get_leaf_idx
+	static std::size_t leaf_index(ptr_type const *lineage) {
+		for (std::size_t i = max_height-1; i > 0; i--) {
+			if (lineage[i] != node_type::invalid_ptr) return i;
+		}
+		return 0;
+	}
+
+	//! @brief See @ref trace_lineage, or @ref trace_to_level given a level
+	ErrorCode trace_lineage(
+		key_view key, ptr_type *lineage, unsigned level = 0
+	) const {
+		std::size_t curr;
+		node_type node;
+		ptr_type prev;
+		version_type version, prev_version{};
+		bool valid;
+		ErrorCode status;
+
+		do {
+			lineage[0] = root();
+			curr = 0;
+			prev = node_type::invalid_ptr;
+			valid = true;
+			while (memory_.level(lineage[curr]) > level) {
+				node = memory_.read_versioned(lineage[curr], version);
+				valid = prev == node_type::invalid_ptr
+					|| memory_.validate(prev, prev_version);
+				if (!valid) break;
+				prev = lineage[curr];
+				prev_version = version;
+				if (node.past_high_key(key)) {
+					lineage[curr] = node.next;
+				} else {
+					status = node.find_next(key, lineage[curr+1]);
+					if (status != SUCCESS) return status;
+					++curr;
+				}
+			}
+			if (!valid) STATS_INC(restarts);
+		} while (!valid);
+		// Drop anything left over from an abandoned, deeper traversal
+		std::fill(lineage + curr + 1, lineage + max_height,
+			node_type::invalid_ptr);
+		return SUCCESS;
+	}
+
+	//! @brief See @ref move_right
+	bool move_right(Located &n, key_view key) {
+		while (n.node.past_high_key(key)) {
+			const ptr_type next = n.node.next;
+			STATS_INC(right_moves);
+			// Lock the sibling before letting go of the node pointing to it
+			const node_type next_node = memory_.read_lock(next);
+			memory_.unlock(n.addr);
+			n.addr = next;
+			n.node = next_node;
+		}
+		if (n.node.before_low_key(key)) {
+			STATS_INC(restarts);
+			memory_.unlock(n.addr);
+			return false;
+		}
+		return true;
+	}
+
+	//! @brief Lock the parent of a locked node, as insert.c does
+	ErrorCode lock_parent(
+		ptr_type *lineage, Located const &child, Located &parent
+	) {
+		const unsigned level = memory_.level(child.addr) + 1;
+		const Key key = child.node.max();
+		ErrorCode status;
+
+		for (;;) {
+			// Only a writer holding the root's lock can replace it
+			if (root() == child.addr) {
+				parent.addr = node_type::invalid_ptr;
+				return SUCCESS;
+			}
+			parent.addr = node_type::invalid_ptr;
+			for (std::size_t i = 0; i < max_height; ++i) {
+				if (lineage[i] != node_type::invalid_ptr
+					&& memory_.level(lineage[i]) == level) {
+					parent.addr = lineage[i];
+					break;
+				}
+			}
+			if (parent.addr != node_type::invalid_ptr) {
+				parent.node = memory_.read_lock(parent.addr);
+				if (move_right(parent, key)) {
+					if (parent.node.find_child(child.addr) != Order) {
+						return SUCCESS;
+					}
+					// The parent covers the child, and no split can be adding
+					// it while the parent is locked, so the child was split off
+					// by an insert which ran out of memory further up
+					memory_.unlock(parent.addr);
+					return OUT_OF_MEMORY;
+				}
+			}
+			STATS_INC(restarts);
+			std::fill(lineage, lineage + max_height, node_type::invalid_ptr);
+			// Going any lower would mean validating the child, which we hold
+			status = trace_lineage(key, lineage, level);
+			if (status != SUCCESS) return status;
+		}
+	}
+
+	//! @brief Find an empty slot on a level and lock it
+	ErrorCode lock_empty_slot(unsigned level, Located &slot) {
+		for (;;) {
+			slot.addr = memory_.alloc(level);
+			if (slot.addr == node_type::invalid_ptr) return OUT_OF_MEMORY;
+			// Check before locking so as not to wait on a node held elsewhere
+			slot.node = memory_.read(slot.addr);
+			if (slot.node.is_valid()) continue;
+			slot.node = memory_.read_lock(slot.addr);
+			if (!slot.node.is_valid()) return SUCCESS;
+			memory_.unlock(slot.addr);
+		}
+	}
+
+	//! @brief Split a locked node, as split.c does
+	//!
+	//! Nothing is written back; see @ref insert for the order to do so in.
+	//! @param[out] separator  The split node's new upper bound
+	//! @return PARENT_FULL if the parent must be split in turn, otherwise an
+	//!         error code representing the success or type of failure of the
+	//!         operation
+	ErrorCode split_node(
+		Located &leaf, Located &parent, Located &sibling, Key &separator
+	) {
+		const unsigned level = memory_.level(leaf.addr);
+		ErrorCode status = lock_empty_slot(level, sibling);
+		if (status != SUCCESS) return status;
+		STATS_INC(splits[level < MAX_LEVELS ? level : MAX_LEVELS-1]);
+
+		sibling.node.next = leaf.node.next;
+		leaf.node.next = sibling.addr;
+		separator = leaf.node.split(sibling.node, level == 0);
+
+		if (parent.addr == node_type::invalid_ptr) {
+			status = split_root(leaf, parent, sibling, separator);
+		} else {
+			status = split_nonroot(leaf, parent, sibling, separator);
+		}
+		if (status != SUCCESS && status != PARENT_FULL) {
+			// Give the slot back; the split node's copy must not be written
+			memory_.unlock(sibling.addr);
+			memory_.free(sibling.addr);
+		}
+		return status;
+	}
+
+	//! @brief Make a new root above a split node and its sibling
+	ErrorCode split_root(
+		Located const &leaf, Located &parent, Located const &sibling,
+		Key const &separator
+	) {
+		ErrorCode status = lock_empty_slot(memory_.level(leaf.addr) + 1, parent);
+		if (status != SUCCESS) return status;
+		STATS_INC(root_splits);
+		parent.node.make_root(
+			separator, leaf.addr, sibling.node.max(), sibling.addr);
+		return SUCCESS;
+	}
+
+	//! @brief Add a split node's sibling to its parent
+	ErrorCode split_nonroot(
+		Located const &leaf, Located &parent, Located const &sibling,
+		Key const &separator
+	) {
+		const std::size_t i = parent.node.find_child(leaf.addr);
+		if (i == Order) return NOT_IMPLEMENTED;
+		// The sibling takes over the old node's upper bound
+		Key sibling_key = sibling.node.max();
+		if (parent.node.key_at(i) > sibling_key) {
+			sibling_key = parent.node.key_at(i);
+		}
+		return parent.node.add_split_child(
+			i, separator, sibling_key, sibling.addr);
+	}
+
+	Memory memory_;
+	std::atomic<ptr_type> root_;
+};
+
+
+} // namespace blink
+
+
+#endif
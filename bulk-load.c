@@ -0,0 +1,155 @@
+#include "bulk-load.h"
+#include "alloc.h"
+#include "insert-helpers.h"
+#include "memory.h"
+#include "node.h"
+
+
+//! @brief Index of the first entry of a node when spreading entries evenly
+//! @param[in] i_node   Index of the node within its level
+//! @param[in] n        Number of entries on the level
+//! @param[in] n_nodes  Number of nodes on the level
+inline static size_t first_entry(size_t i_node, size_t n, size_t n_nodes) {
+	return (i_node * n) / n_nodes;
+}
+
+//! @brief Number of nodes needed to hold entries at the given fill
+inline static size_t nodes_needed(size_t n, li_t fill) {
+	return (n + fill - 1) / fill;
+}
+
+//! @brief Number of inner nodes to place above a level of children
+//!
+//! As many as filling each to the given fill takes, but no more than half
+//! the children, so that spreading them evenly never leaves a node with a
+//! single child. That may put up to 3 children in a node, more than a
+//! TREE_ORDER of 2 allows.
+inline static size_t inner_nodes_needed(size_t n_children, li_t fill) {
+	const size_t needed = nodes_needed(n_children, fill);
+	const size_t most = (n_children < 2) ? 1 : n_children / 2;
+	return (TREE_ORDER < 3 || needed < most) ? needed : most;
+}
+
+
+//! @brief Give back the runs reserved for the lowest levels of a tree which
+//!        did not fit
+//! @param[in] height  Number of levels with a run
+static void free_runs(
+	bptr_t const *bases, size_t const *n_nodes, uint_fast8_t height
+) {
+	for (uint_fast8_t level = 0; level < height; ++level) {
+		free_run(bases[level], n_nodes[level]);
+	}
+}
+
+
+//! @brief Write the leaf level
+//! @param[in] base  Address at which to place the first leaf
+static void load_leaves(
+	bkey_t const *keys, bval_t const *values, size_t n, bptr_t base,
+	size_t n_leaves
+) {
+	AddrNode leaf;
+
+	for (size_t j = 0; j < n_leaves; ++j) {
+		const size_t begin = first_entry(j, n, n_leaves);
+		const size_t end = first_entry(j+1, n, n_leaves);
+		leaf.addr = base + j;
+		claim_slot(leaf.addr);
+		leaf.node = mem_read_lock(leaf.addr);
+		clear(&leaf.node);
+		set_level(&leaf.node, 0);
+		for (size_t i = begin; i < end; ++i) {
+			leaf.node.keys[i - begin] = keys[i];
+			leaf.node.values[i - begin] = values[i];
+		}
+		leaf.node.next = (j+1 < n_leaves) ? leaf.addr+1 : INVALID;
+		leaf.node.low_key = (j > 0) ? keys[begin-1] : INVALID;
+		leaf.node.high_key = (j+1 < n_leaves) ? keys[end-1] : INVALID;
+		mem_write_unlock(&leaf);
+	}
+}
+
+
+//! @brief Write one inner level above a contiguous run of children
+//! @param[in] child_base  Address of the first child
+//! @param[in] n_children  Number of children on the level below
+//! @param[in] base        Address at which to place the first new node
+//! @param[in] n_nodes     Number of nodes to place on this level
+//! @param[in] level       Level of the tree being written
+static void load_inner(
+	bptr_t child_base, size_t n_children, bptr_t base, size_t n_nodes,
+	uint_fast8_t level
+) {
+	AddrNode inner;
+	Node child;
+	bkey_t low_key = INVALID;
+
+	for (size_t j = 0; j < n_nodes; ++j) {
+		const size_t begin = first_entry(j, n_children, n_nodes);
+		const size_t end = first_entry(j+1, n_children, n_nodes);
+		inner.addr = base + j;
+		claim_slot(inner.addr);
+		inner.node = mem_read_lock(inner.addr);
+		clear(&inner.node);
+		set_level(&inner.node, level);
+		for (size_t i = begin; i < end; ++i) {
+			child = mem_read(child_base + i);
+			inner.node.keys[i - begin] = max(&child);
+			inner.node.values[i - begin].ptr = child_base + i;
+		}
+		inner.node.next = (j+1 < n_nodes) ? inner.addr+1 : INVALID;
+		inner.node.low_key = low_key;
+		inner.node.high_key = (j+1 < n_nodes) ? max(&inner.node) : INVALID;
+		low_key = inner.node.high_key;
+		mem_write_unlock(&inner);
+	}
+}
+
+
+ErrorCode bulk_load(
+	bptr_t *root, bkey_t const *keys, bval_t const *values, size_t n, li_t fill
+) {
+	const li_t inner_fill = (fill < 2) ? 2 : fill;
+	const bptr_t region = get_region(*root);
+	size_t n_nodes[MAX_LEVELS];
+	bptr_t bases[MAX_LEVELS];
+	uint_fast8_t height = 0;
+	Node old_root;
+
+	if (fill == 0 || fill > TREE_ORDER) return INVALID_ARGUMENT;
+	// Only an empty tree can be loaded
+	old_root = mem_read(*root);
+	if (!is_leaf(*root) || is_valid(&old_root)) return INVALID_ARGUMENT;
+	for (size_t i = 0; i < n; ++i) {
+		if (keys[i] == INVALID || (i > 0 && keys[i-1] >= keys[i])) {
+			return INVALID_ARGUMENT;
+		}
+	}
+	if (n == 0) return SUCCESS;
+
+	// Find room for the whole tree before writing anything, stacking inner
+	// levels until one node remains to be the root
+	for (size_t n_level = nodes_needed(n, fill);;
+		n_level = inner_nodes_needed(n_level, inner_fill)) {
+		if (height >= MAX_LEVELS || n_level > MEM_SIZE) {
+			free_runs(bases, n_nodes, height);
+			return OUT_OF_MEMORY;
+		}
+		bases[height] = alloc_run(height, region, n_level);
+		if (bases[height] == INVALID) {
+			free_runs(bases, n_nodes, height);
+			return OUT_OF_MEMORY;
+		}
+		n_nodes[height++] = n_level;
+		if (n_level == 1) break;
+	}
+
+	load_leaves(keys, values, n, bases[0], n_nodes[0]);
+	for (uint_fast8_t level = 1; level < height; ++level) {
+		load_inner(bases[level-1], n_nodes[level-1], bases[level],
+			n_nodes[level], level);
+	}
+	*root = bases[height-1];
+	return SUCCESS;
+}
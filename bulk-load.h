@@ -0,0 +1,29 @@
+#ifndef BULK_LOAD_H
+#define BULK_LOAD_H
+
+#include "types.h"
+#include <stddef.h>
+
+//! @brief Build a tree bottom-up from entries already sorted by key
+//!
+//! Leaves are packed into a run of consecutive addresses and linked through
+//! `next`, then each inner level is built the same way in a run of its own
+//! until a single root remains, all within the root's region of memory.
+//! Entries are spread evenly so that no node is left less than half full.
+//! @param[inout] root    The address of the root of the tree to load, which
+//!                       must be an empty leaf. Set to the new root.
+//! @param[in]    keys    Keys to load, in strictly increasing order
+//! @param[in]    values  Values corresponding to each key
+//! @param[in]    n       Number of entries to load
+//! @param[in]    fill    Target number of entries per node, from 1 up to
+//!                       TREE_ORDER. Values below TREE_ORDER leave room for
+//!                       later inserts before nodes need to split. Inner
+//!                       nodes always hold at least 2 children, given a
+//!                       TREE_ORDER of at least 3.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode bulk_load(
+	bptr_t *root, bkey_t const *keys, bval_t const *values, size_t n, li_t fill
+);
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef CORO_ENGINE_HPP
+#define CORO_ENGINE_HPP
+
+//! @file coro-engine.hpp
+//! @brief Interleaved execution of C tree operations as C++20 coroutines
+//!
+//! The hardware pipeline keeps many operations in flight so that the latency
+//! of one operation's memory reads overlaps with the work of the others. On a
+//! CPU, @ref search and @ref insert run one at a time and stall on each node
+//! that misses the cache. Here each operation is a coroutine which, before
+//! reading a node, asks the memory backend to prefetch it and suspends.
+//! @ref blink::interleave resumes a group of operations round-robin, so by
+//! the time an operation is resumed its node has most likely arrived.
+//!
+//! Searches follow search.c step for step. Inserts descend the same way and
+//! then hand the path they found to @ref append, which starts from its leaf. Operations in a group run on the calling thread, so
+//! they can neither block each other nor hold a lock while suspended; any
+//! number of threads may run groups of their own at once.
+//!
+//! Needs C++20, and links against the C sources like blink-tree-c.hpp.
+
+
+// Pulled in ahead of the C headers so that they are not seen as C
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "insert.h"
+#include "memory.h"
+#include "node.h"
+}
+
+
+namespace blink {
+
+
+//! @brief Free lists of coroutine frames, in size classes
+//!
+//! Each thread has its own, so frames must be freed by the thread which
+//! allocated them, as they are by @ref interleave.
+class FramePool {
+public:
+	FramePool() = default;
+	FramePool(FramePool const &) = delete;
+	FramePool &operator=(FramePool const &) = delete;
+
+	~FramePool() {
+		for (auto &head : heads) {
+			while (head) ::operator delete(std::exchange(head, head->next));
+		}
+	}
+
+	void *allocate(std::size_t size) {
+		const std::size_t c = size_class(size);
+		if (c < classes && heads[c]) {
+			return std::exchange(heads[c], heads[c]->next);
+		}
+		return ::operator new((c + 1) * granule);
+	}
+
+	void release(void *frame, std::size_t size) {
+		const std::size_t c = size_class(size);
+		if (c < classes) {
+			heads[c] = new (frame) Free{heads[c]};
+		} else {
+			::operator delete(frame);
+		}
+	}
+
+private:
+	struct Free {
+		Free *next;
+	};
+
+	//! @brief Frames are rounded up to a multiple of this many bytes, and
+	//!        only those of up to this many multiples are kept
+	static constexpr std::size_t granule = 64;
+	static constexpr std::size_t classes = 32;
+
+	static std::size_t size_class(std::size_t size) {
+		return (size - 1) / granule;
+	}
+
+	Free *heads[classes] = {};
+};
+
+inline thread_local FramePool frame_pool;
+
+
+//! @brief A tree operation suspended at a node read, owning its coroutine
+class Operation {
+public:
+	struct promise_type {
+		Operation get_return_object() {
+			return Operation(handle::from_promise(*this));
+		}
+		// Nothing runs until the scheduler first resumes the operation
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+
+		// Operations are short and started at a high rate
+		static void *operator new(std::size_t size) {
+			return frame_pool.allocate(size);
+		}
+		static void operator delete(void *frame, std::size_t size) {
+			frame_pool.release(frame, size);
+		}
+	};
+
+	Operation() = default;
+	Operation(Operation &&other) noexcept :
+		coroutine(std::exchange(other.coroutine, nullptr)) {}
+	Operation &operator=(Operation &&other) noexcept {
+		if (this != &other) {
+			if (coroutine) coroutine.destroy();
+			coroutine = std::exchange(other.coroutine, nullptr);
+		}
+		return *this;
+	}
+	~Operation() {
+		if (coroutine) coroutine.destroy();
+	}
+
+	//! @brief Whether there is an operation which has yet to finish
+	bool pending() const { return coroutine && !coroutine.done(); }
+
+	//! @brief Run the operation up to its next node read, or to the end
+	void step() { coroutine.resume(); }
+
+private:
+	using handle = std::coroutine_handle<promise_type>;
+
+	explicit Operation(handle h) : coroutine(h) {}
+
+	handle coroutine = nullptr;
+};
+
+
+//! @brief Awaited before reading a node; starts fetching it and suspends
+struct Fetch {
+	bptr_t addr;
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<>) const noexcept {
+		mem_prefetch(addr);
+	}
+	void await_resume() const noexcept {}
+};
+
+
+//! @brief Search the tree for a key, as @ref search does
+//! @param[in]  root    The root of the tree to search
+//! @param[in]  key     The key to search for
+//! @param[out] result  Where to store the outcome, as @ref search returns it
+inline Operation search_op(bptr_t root, bkey_t key, bstatusval_t &result) {
+	AddrNode n;
+	bptr_t parent;
+	bver_t version, parent_version = 0;
+	bool valid;
+
+	do {
+		n.addr = root;
+		parent = INVALID;
+		valid = true;
+		while (valid) {
+			co_await Fetch{n.addr};
+			n.node = mem_read_versioned(n.addr, &version);
+			valid = parent == INVALID || mem_validate(parent, parent_version);
+			if (!valid) {
+				STATS_INC(restarts);
+				break;
+			}
+			if (is_leaf(n.addr) && !past_high_key(&n.node, key)) break;
+			result = find_next(&n.node, key);
+			if (result.status != SUCCESS) co_return;
+			parent = n.addr;
+			parent_version = version;
+			n.addr = result.value.ptr;
+		}
+	} while (!valid);
+
+	result = find_value(&n.node, key);
+}
+
+
+//! @brief Insert a new key and value, as @ref insert does
+//!
+//! Traces the path to the key's leaf a node at a time, prefetching each node
+//! before reading it, and then inserts through @ref append with that path as
+//! its finger, so the insert goes straight to the leaf rather than
+//! descending again. No lock is taken until then, and none is held across a
+//! suspension.
+//! @param[inout] root    The address of the root of the tree to insert into
+//! @param[in]    key     The key under which the value should be stored
+//! @param[in]    value   The value to store
+//! @param[out]   status  Where to store the outcome of the insert
+inline Operation insert_op(
+	bptr_t *root, bkey_t key, bval_t value, ErrorCode &status
+) {
+	bptr_t addr = *root;
+	const uint_fast8_t top = get_level(addr);
+	Finger finger;
+	Node node;
+	bstatusval_t next;
+
+	finger_init(&finger);
+	// Nodes read here are only hints, so are not validated. append checks
+	// that the leaf still covers the key and traces the path again if not,
+	// and a path through nodes which changed meanwhile is given up on before
+	// long.
+	for (unsigned hops = 0; hops < 2*MAX_LEVELS; ++hops) {
+		co_await Fetch{addr};
+		node = mem_read(addr);
+		// The slot may have been reused further up since it was reached
+		if (get_level(addr) > top) break;
+		finger.lineage[top - get_level(addr)] = addr;
+		if (is_leaf(addr) && !past_high_key(&node, key)) break;
+		next = find_next(&node, key);
+		if (next.status != SUCCESS || next.value.ptr == INVALID) break;
+		addr = next.value.ptr;
+	}
+
+	status = append(root, &finger, key, value);
+}
+
+
+//! @brief Run operations in groups, interleaving those in each group
+//!
+//! Keeps up to `group` operations in flight, resuming each in turn until it
+//! reaches its next node read, and starting a new one as soon as any
+//! finishes. With a group of one, operations run back to back.
+//! @param[in] count  Number of operations to run
+//! @param[in] group  Number of operations to keep in flight at once
+//! @param[in] start  Called with each index below `count`, in order, to
+//!                   create the operation for it
+template <typename Start>
+void interleave(std::size_t count, std::size_t group, Start &&start) {
+	std::vector<Operation> slots(group ? group : 1);
+	std::size_t started = 0;
+	std::size_t running = 0;
+
+	for (auto &slot : slots) {
+		if (started == count) break;
+		slot = start(started++);
+		++running;
+	}
+	while (running > 0) {
+		for (auto &slot : slots) {
+			if (!slot.pending()) continue;
+			slot.step();
+			if (slot.pending()) continue;
+			if (started < count) {
+				slot = start(started++);
+			} else {
+				slot = Operation();
+				--running;
+			}
+		}
+	}
+}
+
+
+//! @brief Search for many keys at once, interleaving the searches
+//! @param[in]  root     The root of the tree to search
+//! @param[in]  keys     The keys to search for
+//! @param[in]  n        Number of keys to search for
+//! @param[out] results  Result of searching for each key, as returned by
+//!                      @ref search
+//! @param[in]  group    Number of searches to keep in flight at once
+inline void search_interleaved(
+	bptr_t root, bkey_t const *keys, std::size_t n, bstatusval_t *results,
+	std::size_t group
+) {
+	interleave(n, group, [&](std::size_t i) {
+		return search_op(root, keys[i], results[i]);
+	});
+}
+
+
+//! @brief Insert many keys at once, interleaving the inserts
+//!
+//! Keys are not guaranteed to be inserted in order, so of any duplicates
+//! within `keys`, it is not known in advance which will get KEY_EXISTS.
+//! @param[inout] root      The address of the root of the tree to insert into
+//! @param[in]    keys      The keys to insert
+//! @param[in]    values    The value to store under each key
+//! @param[in]    n         Number of keys to insert
+//! @param[out]   statuses  Outcome of inserting each key
+//! @param[in]    group     Number of inserts to keep in flight at once
+inline void insert_interleaved(
+	bptr_t *root, bkey_t const *keys, bval_t const *values, std::size_t n,
+	ErrorCode *statuses, std::size_t group
+) {
+	interleave(n, group, [&](std::size_t i) {
+		return insert_op(root, keys[i], values[i], statuses[i]);
+	});
+}
+
+
+} // namespace blink
+
+
+#endif
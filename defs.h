@@ -10,6 +10,21 @@
 #ifndef MAX_NODES_PER_LEVEL
 #define MAX_NODES_PER_LEVEL (10)
 #endif
+//! Levels normally each own a fixed MAX_NODES_PER_LEVEL slice of memory.
+//! Building with `-DELASTIC_LEVELS` instead hands memory out to levels a chunk
+//! at a time as they grow, so that all of MEM_SIZE is shared by the whole
+//! tree and MAX_LEVELS only bounds its height.
+#ifdef ELASTIC_LEVELS
+//! Number of nodes given to a level at a time, a multiple of 64
+#ifndef LEVEL_CHUNK_SIZE
+#define LEVEL_CHUNK_SIZE (64)
+#endif
+//! With at least two children per node, no taller tree fits in 32-bit
+//! addresses
+#ifndef MAX_LEVELS
+#define MAX_LEVELS (32)
+#endif
+#endif
 //! Maximum height of a tree
 #ifndef MAX_LEVELS
 #define MAX_LEVELS (4)
@@ -22,5 +37,46 @@
 #ifndef MEM_SIZE
 #define MEM_SIZE (MAX_NODES_PER_LEVEL * MAX_LEVELS)
 #endif
+//! Number of regions memory is divided into, each able to hold a separate
+//! tree whose nodes are allocated only within it, as in a @ref Forest. Each
+//! level of the grid is divided evenly, or with `-DELASTIC_LEVELS`, the
+//! chunks of memory are.
+#ifndef MEM_REGIONS
+#define MEM_REGIONS (1)
+#endif
+//! Entries kept by the rightmost node of a level when it splits to make room
+//! for a key beyond all of its own, as when keys are inserted in increasing
+//! order. The rest, about a tenth, go to the new sibling, which will take the
+//! keys that follow, so that the nodes left behind stay nearly full. Half of
+//! TREE_ORDER, rounded up, splits these nodes evenly like any other.
+#ifndef APPEND_SPLIT_KEEP
+#define APPEND_SPLIT_KEEP (TREE_ORDER - (TREE_ORDER + 9) / 10)
+#endif
+//! Host builds may pass `-DNODE_CACHE` to keep recently read nodes in a
+//! set-associative cache in front of the memory backend, which pays off when
+//! backing memory is slow to reach, as with a mapped file.
+#ifdef NODE_CACHE
+//! Number of sets in the node cache
+#ifndef NODE_CACHE_SETS
+#define NODE_CACHE_SETS (1024)
+#endif
+//! Number of nodes each set of the node cache holds
+#ifndef NODE_CACHE_WAYS
+#define NODE_CACHE_WAYS (8)
+#endif
+//! Lowest level whose nodes, once cached, are never evicted, the leaves being
+//! level 0. Upper levels are read by every operation and hold few nodes.
+#ifndef NODE_CACHE_PIN_LEVEL
+#define NODE_CACHE_PIN_LEVEL (2)
+#endif
+#endif
+//! Host builds may pass `-DMEM_TRACE` to record every node access made through
+//! the memory backend while a trace is open, for offline analysis.
+#ifdef MEM_TRACE
+//! Events each thread collects before appending them to the trace file
+#ifndef MEM_TRACE_BUFFER
+#define MEM_TRACE_BUFFER (4096)
+#endif
+#endif
 
 #endif
@@ -0,0 +1,281 @@
+#include "erase.h"
+#include "alloc.h"
+#include "insert-helpers.h"
+#include "memory.h"
+#include "node.h"
+#include "tree-helpers.h"
+#include <string.h>
+
+
+//! @brief Fewest entries a node other than the root should hold
+#define MIN_KEYS (TREE_ORDER/2)
+
+//! @brief Times to try rebalancing a leaf before leaving it underfull
+//!
+//! Enough for a chain of only children to be collapsed into the root one
+//! level per attempt
+#define REBALANCE_ATTEMPTS MAX_LEVELS
+
+
+//! @brief Find the index of a key within a node
+//! @return Index of the key, or TREE_ORDER if it is not present
+static li_t find_key(Node const *node, bkey_t key) {
+	li_t i = 0;
+	while (i < TREE_ORDER && node->keys[i] != key) ++i;
+	return i;
+}
+
+//! @brief Remove the entry at an index, shifting later entries left
+static void remove_at(Node *node, li_t i) {
+	for (; i < TREE_ORDER-1; ++i) {
+		node->keys[i] = node->keys[i+1];
+		node->values[i] = node->values[i+1];
+	}
+	node->keys[TREE_ORDER-1] = INVALID;
+	node->values[TREE_ORDER-1].data = INVALID;
+}
+
+//! @brief Move all of a node's entries onto the end of its left sibling
+//!
+//! Leaves the right node cleared so that its slot can be reallocated
+static void merge(Node *left, Node *right) {
+	const li_t n_left = num_keys(left);
+	for (li_t i = 0; i < TREE_ORDER && right->keys[i] != INVALID; ++i) {
+		left->keys[n_left + i] = right->keys[i];
+		left->values[n_left + i] = right->values[i];
+	}
+	left->next = right->next;
+	left->high_key = right->high_key;
+	retire(right);
+}
+
+//! @brief Even out the number of entries held by a pair of siblings
+static void redistribute(Node *left, Node *right) {
+	li_t n_left = num_keys(left);
+	li_t n_right = num_keys(right);
+	const li_t target = (n_left + n_right) / 2;
+
+	// Shift from the front of right onto the end of left
+	for (; n_left < target; ++n_left, --n_right) {
+		left->keys[n_left] = right->keys[0];
+		left->values[n_left] = right->values[0];
+		remove_at(right, 0);
+	}
+	// Shift from the end of left onto the front of right
+	for (; n_left > target && n_left > n_right; --n_left, ++n_right) {
+		for (li_t i = n_right; i > 0; --i) {
+			right->keys[i] = right->keys[i-1];
+			right->values[i] = right->values[i-1];
+		}
+		right->keys[0] = left->keys[n_left-1];
+		right->values[0] = left->values[n_left-1];
+		left->keys[n_left-1] = INVALID;
+		left->values[n_left-1].data = INVALID;
+	}
+}
+
+
+//! @brief Replace a root which has only one child with that child
+//!
+//! The old root's slot goes straight back to its level's pool. Anything
+//! which read the root pointer before it changed may still start from the
+//! old root, so it is retired but left pointing at its child, which
+//! @ref find_next follows, until the slot is reused. Until the tree grows
+//! taller than it was before the collapse, only a new root can take the
+//! slot, and that leads everywhere too.
+//! @param[inout] root  Root of the tree
+//! @param[in]    addr  Address of the root as seen by the caller
+static void collapse_root(bptr_t *root, bptr_t addr) {
+	AddrNode old_root;
+	bptr_t child;
+	old_root.addr = addr;
+	old_root.node = mem_read_lock(addr);
+	if (*root != addr || num_keys(&old_root.node) != 1) {
+		mem_unlock(addr);
+		return;
+	}
+	child = old_root.node.values[0].ptr;
+	*root = child;
+	retire(&old_root.node);
+	old_root.node.values[0].ptr = child;
+	mem_write_unlock(&old_root);
+	free_slot(addr);
+}
+
+
+//! @brief Refill an underfull node from its sibling, merging the two if their
+//!        entries fit in one node, and optionally remove a key in the process
+//!
+//! Locks are taken left to right along the level and then on the parent,
+//! bottom-up like @ref insert, and the pairing is validated once they are
+//! held.
+//! @return False if the tree changed underneath the operation and it should
+//!         be retried from a fresh lineage, true otherwise
+static bool rebalance(
+	//! [inout] Root of the tree the nodes reside in
+	bptr_t *root,
+	//! [in] Path from the root to the node to rebalance
+	bptr_t const *lineage,
+	//! [in] Index of the node to rebalance within the lineage
+	uint_fast8_t i_node,
+	//! [in] Key to remove from the node, or INVALID for none
+	bkey_t key,
+	//! [out] Outcome of the key removal
+	ErrorCode *status,
+	//! [out] Number of entries left in the parent
+	li_t *n_parent
+) {
+	AddrNode parent, left, right, *target;
+	li_t i;
+
+	*status = SUCCESS;
+	*n_parent = MIN_KEYS;
+	parent.addr = lineage[i_node-1];
+	parent.node = mem_read(parent.addr);
+	i = find_child(&parent.node, lineage[i_node]);
+	if (i == TREE_ORDER) return false;
+	// Pair with the right sibling if there is one, else with the left
+	if (i+1 < TREE_ORDER && parent.node.keys[i+1] != INVALID) {
+		left.addr = lineage[i_node];
+		right.addr = parent.node.values[i+1].ptr;
+	} else if (i > 0) {
+		left.addr = parent.node.values[i-1].ptr;
+		right.addr = lineage[i_node];
+	} else {
+		// An only child must wait for its parent to gain a sibling
+		if (i_node == 1) {
+			collapse_root(root, parent.addr);
+		} else {
+			rebalance(root, lineage, i_node-1, INVALID, status, n_parent);
+			*status = SUCCESS;
+		}
+		return false;
+	}
+	target = (left.addr == lineage[i_node]) ? &left : &right;
+
+	left.node = mem_read_lock(left.addr);
+	right.node = mem_read_lock(right.addr);
+	parent.node = mem_read_lock(parent.addr);
+	i = find_child(&parent.node, left.addr);
+	// The pairing may have changed, or the key may have moved to another
+	// node, while nothing was locked
+	if (i+1 >= TREE_ORDER || parent.node.keys[i+1] == INVALID
+		|| parent.node.values[i+1].ptr != right.addr
+		|| (key != INVALID && (past_high_key(&target->node, key)
+			|| before_low_key(&target->node, key)))) {
+		mem_unlock(parent.addr);
+		mem_unlock(right.addr);
+		mem_unlock(left.addr);
+		return false;
+	}
+
+	if (key != INVALID) {
+		const li_t i_key = find_key(&target->node, key);
+		if (i_key == TREE_ORDER) {
+			*status = NOT_FOUND;
+		} else {
+			remove_at(&target->node, i_key);
+		}
+	}
+	// Nothing to do if the node was refilled while unlocked. Nor can anything
+	// be done if a split left a sibling between the pair without a parent,
+	// which happens when there was no room to split the parent.
+	if (*status != SUCCESS || num_keys(&target->node) >= MIN_KEYS
+		|| left.node.next != right.addr) {
+		mem_unlock(parent.addr);
+		mem_unlock(target == &left ? right.addr : left.addr);
+		if (*status == SUCCESS) {
+			mem_write_unlock(target);
+		} else {
+			mem_unlock(target->addr);
+		}
+		return true;
+	}
+
+	if (num_keys(&left.node) + num_keys(&right.node) <= TREE_ORDER) {
+		merge(&left.node, &right.node);
+		// Left now covers right's range, so it takes over right's key
+		parent.node.values[i+1].ptr = left.addr;
+		remove_at(&parent.node, i);
+	} else {
+		const bkey_t old_key = parent.node.keys[i];
+		redistribute(&left.node, &right.node);
+		left.node.high_key = max(&left.node);
+		right.node.low_key = left.node.high_key;
+		rekey(&parent.node, old_key, left.node.high_key);
+	}
+	*n_parent = num_keys(&parent.node);
+
+	// Publish the surviving node before its sibling is unlinked or cleared
+	mem_write_unlock(&left);
+	mem_write_unlock(&parent);
+	mem_write_unlock(&right);
+	if (!is_valid(&right.node)) free_slot(right.addr);
+	if (parent.addr == *root && *n_parent == 1) {
+		collapse_root(root, parent.addr);
+	}
+	return true;
+}
+
+
+ErrorCode erase(bptr_t *root, bkey_t key) {
+	ErrorCode status;
+	uint_fast8_t i_leaf;
+	AddrNode leaf;
+	bptr_t lineage[MAX_LEVELS];
+	li_t i_key, n_parent;
+
+	if (key == INVALID) return INVALID_ARGUMENT;
+	for (unsigned attempts = 0;; ++attempts) {
+		memset(lineage, INVALID, MAX_LEVELS*sizeof(bptr_t));
+		status = trace_lineage(*root, key, lineage);
+		if (status != SUCCESS) return status;
+		i_leaf = get_leaf_idx(lineage);
+		leaf.addr = lineage[i_leaf];
+		leaf.node = mem_read_lock(leaf.addr);
+		// The leaf may have changed since its parent was read
+		if (!move_right(&leaf, key)) continue;
+		lineage[i_leaf] = leaf.addr;
+		i_key = find_key(&leaf.node, key);
+		if (i_key == TREE_ORDER) {
+			mem_unlock(leaf.addr);
+			return NOT_FOUND;
+		}
+		// Common case, the leaf stays at least half full
+		if (leaf.addr == *root || num_keys(&leaf.node) > MIN_KEYS) {
+			remove_at(&leaf.node, i_key);
+			mem_write_unlock(&leaf);
+			return SUCCESS;
+		}
+		// Rebalancing keeps failing for as long as an only child's parent
+		// cannot gain a sibling, so settle for an underfull leaf, just as
+		// propagating underflow upwards is only best effort. Emptying the
+		// leaf would hand it to the allocator while it is still linked.
+		if (attempts >= REBALANCE_ATTEMPTS) {
+			if (num_keys(&leaf.node) == 1) {
+				mem_unlock(leaf.addr);
+				return NOT_IMPLEMENTED;
+			}
+			remove_at(&leaf.node, i_key);
+			mem_write_unlock(&leaf);
+			return SUCCESS;
+		}
+		// Otherwise the removal has to happen along with the rebalancing so
+		// that an empty leaf is never visible to the allocator
+		mem_unlock(leaf.addr);
+		// A lineage traced before the root split has no parent for the leaf
+		if (i_leaf > 0
+			&& rebalance(root, lineage, i_leaf, key, &status, &n_parent)) {
+			break;
+		}
+		STATS_INC(restarts);
+	}
+	if (status != SUCCESS) return status;
+
+	// Propagate underflow upwards on a best-effort basis
+	for (uint_fast8_t i = i_leaf-1; i > 0 && n_parent < MIN_KEYS; --i) {
+		ErrorCode ignored;
+		if (!rebalance(root, lineage, i, INVALID, &ignored, &n_parent)) break;
+	}
+	return SUCCESS;
+}
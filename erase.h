@@ -0,0 +1,23 @@
+#ifndef ERASE_H
+#define ERASE_H
+
+#include "types.h"
+
+//! @brief Remove a key and its value from the tree
+//!
+//! Nodes left less than half full are refilled from, or merged with, an
+//! adjacent sibling under the same parent, or left underfull should that
+//! keep failing. Nodes emptied by a merge are returned to their level's pool
+//! of free slots, as is the old root whenever the root is collapsed into its
+//! only child, so a tree emptied by erases gives back every slot it used. A
+//! root read before such a collapse still leads to the new one until the
+//! tree grows taller than it was.
+//! @param[inout] root  The address of the root of the tree to remove from
+//! @param[in]    key   The key to remove
+//! @return NOT_IMPLEMENTED if the key is the last in a leaf which could not
+//!         be rebalanced, for instance because a split which ran out of
+//!         memory left its parent without a sibling, otherwise an error code
+//!         representing the success or type of failure of the operation
+ErrorCode erase(bptr_t *root, bkey_t key);
+
+#endif
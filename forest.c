@@ -0,0 +1,146 @@
+#include "forest.h"
+#include "alloc.h"
+#include "bulk-load.h"
+#include "erase.h"
+#include "memory.h"
+#include "node.h"
+#include "search.h"
+
+
+//! @brief Context of @ref forward, wrapping the caller's callback
+typedef struct {
+	scan_fn_t fn;
+	void *ctx;
+	//! @brief Set once the caller's callback asks to stop
+	bool stopped;
+} ForestScan;
+
+
+//! @brief Pass an entry on to the caller's callback, noting if it stops
+//!        the scan so that the scan doesn't move on to the next tree
+static bool forward(bkey_t key, bval_t value, void *ctx) {
+	ForestScan *s = ctx;
+	if (!s->fn(key, value, s->ctx)) s->stopped = true;
+	return !s->stopped;
+}
+
+
+ErrorCode forest_init(Forest *forest, size_t n_trees, bkey_t const *bounds) {
+	if (n_trees == 0 || n_trees > MEM_REGIONS) return INVALID_ARGUMENT;
+	forest->n_trees = n_trees;
+	forest->lows[0] = 0;
+	for (size_t i = 1; i < n_trees; ++i) {
+		forest->lows[i] = bounds
+			? bounds[i-1]
+			: (bkey_t) (((uint64_t) i << (8 * sizeof(bkey_t))) / n_trees);
+		if (forest->lows[i] <= forest->lows[i-1] || forest->lows[i] == INVALID) {
+			return INVALID_ARGUMENT;
+		}
+	}
+	for (size_t i = 0; i < n_trees; ++i) {
+		Node root;
+		forest->roots[i] = alloc_root(i);
+		if (forest->roots[i] == INVALID) return INVALID_ARGUMENT;
+		// The root must be an empty leaf, not part of some earlier tree
+		root = mem_read(forest->roots[i]);
+		if (is_valid(&root)) return INVALID_ARGUMENT;
+	}
+	return SUCCESS;
+}
+
+
+size_t forest_tree_of(Forest const *forest, bkey_t key) {
+	size_t lo = 0, hi = forest->n_trees;
+	// Find the last tree whose smallest key is not above the key
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (forest->lows[mid] <= key) lo = mid;
+		else hi = mid;
+	}
+	return lo;
+}
+
+
+bstatusval_t forest_search(Forest const *forest, bkey_t key) {
+	return search(forest->roots[forest_tree_of(forest, key)], key);
+}
+
+
+ErrorCode forest_insert(Forest *forest, bkey_t key, bval_t value) {
+	return insert(&forest->roots[forest_tree_of(forest, key)], key, value);
+}
+
+
+ErrorCode forest_upsert(Forest *forest, bkey_t key, bval_t value) {
+	return upsert(&forest->roots[forest_tree_of(forest, key)], key, value);
+}
+
+
+ErrorCode forest_update_fn(
+	Forest *forest, bkey_t key, update_fn_t fn, void *ctx
+) {
+	return update_fn(
+		&forest->roots[forest_tree_of(forest, key)], key, fn, ctx);
+}
+
+
+ErrorCode forest_erase(Forest *forest, bkey_t key) {
+	return erase(&forest->roots[forest_tree_of(forest, key)], key);
+}
+
+
+ErrorCode forest_bulk_load(
+	Forest *forest, bkey_t const *keys, bval_t const *values, size_t n,
+	li_t fill
+) {
+	size_t from = 0;
+	for (size_t t = 0; t < forest->n_trees; ++t) {
+		size_t to = from;
+		ErrorCode status;
+		// Entries up to the next tree's smallest key belong to this one
+		if (t + 1 == forest->n_trees) to = n;
+		else while (to < n && keys[to] < forest->lows[t+1]) ++to;
+		status = bulk_load(&forest->roots[t], keys + from, values + from,
+			to - from, fill);
+		if (status != SUCCESS) return status;
+		from = to;
+	}
+	return SUCCESS;
+}
+
+
+ErrorCode forest_scan(
+	Forest const *forest, ScanCursor *cursor, size_t limit,
+	scan_fn_t fn, void *ctx, size_t *count
+) {
+	ForestScan s = {fn, ctx, false};
+	ErrorCode status = SUCCESS;
+	size_t total = 0;
+
+	while (!cursor->done && !s.stopped && (limit == 0 || total < limit)) {
+		const size_t t = forest_tree_of(forest, cursor->lo);
+		const bool last = (t + 1 == forest->n_trees);
+		ScanCursor part = *cursor;
+		size_t n;
+
+		// Stop this tree's part of the scan where the next tree's keys begin
+		if (!last && forest->lows[t+1] < cursor->hi) {
+			part.hi = forest->lows[t+1];
+		}
+		status = scan(forest->roots[t], &part, limit ? limit - total : 0,
+			forward, &s, &n);
+		total += n;
+		cursor->leaf = part.leaf;
+		cursor->lo = part.lo;
+		if (status != SUCCESS || !part.done) break;
+		if (part.hi == cursor->hi) {
+			cursor->done = true;
+		} else {
+			// The leaf hint belongs to the tree just finished
+			cursor->lo = part.hi;
+			cursor->leaf = INVALID;
+		}
+	}
+	if (count != NULL) *count = total;
+	return status;
+}
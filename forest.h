@@ -0,0 +1,102 @@
+#ifndef FOREST_H
+#define FOREST_H
+
+#include "insert.h"
+#include "scan.h"
+#include "types.h"
+#include <stddef.h>
+
+
+//! @brief Independent trees which between them hold one key space
+//!
+//! The key space is divided into consecutive ranges, each held by a tree of
+//! its own in a region of memory of its own, so that operations on different
+//! trees share no nodes, no locks and no root. Build with MEM_REGIONS no
+//! smaller than the number of trees. Each region has MEM_SIZE / MEM_REGIONS
+//! nodes to grow into, so that much room goes with each tree regardless of
+//! how its keys turn out.
+typedef struct {
+	//! @brief Number of trees, from 1 up to MEM_REGIONS
+	size_t n_trees;
+	//! @brief Smallest key each tree holds, tree `i` holding the keys from
+	//!        `lows[i]` up to but excluding `lows[i+1]`. `lows[0]` is 0.
+	bkey_t lows[MEM_REGIONS];
+	//! @brief Root of each tree, tree `i` residing in region `i`
+	bptr_t roots[MEM_REGIONS];
+} Forest;
+
+
+//! @brief Set up a forest of empty trees
+//!
+//! The trees' regions of memory must be empty, as after @ref mem_reset_all.
+//! @param[out] forest   The forest to set up
+//! @param[in]  n_trees  Number of trees, from 1 up to MEM_REGIONS
+//! @param[in]  bounds   The smallest key of each tree after the first, in
+//!                      strictly increasing order, or NULL to divide the
+//!                      key space evenly
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode forest_init(Forest *forest, size_t n_trees, bkey_t const *bounds);
+
+//! @brief Find which tree of a forest holds a key
+//!
+//! Lets the keys be shared out among threads so that each works on a tree
+//! of its own.
+//! @param[in] forest  The forest to look in
+//! @param[in] key     The key to look up
+//! @return Index of the tree, whose root is `forest->roots[index]`
+size_t forest_tree_of(Forest const *forest, bkey_t key);
+
+//! @brief Search a forest for a key, as @ref search does a tree
+bstatusval_t forest_search(Forest const *forest, bkey_t key);
+
+//! @brief Insert a key into a forest, as @ref insert does into a tree
+ErrorCode forest_insert(Forest *forest, bkey_t key, bval_t value);
+
+//! @brief Insert or replace a key in a forest, as @ref upsert does in a tree
+ErrorCode forest_upsert(Forest *forest, bkey_t key, bval_t value);
+
+//! @brief Update the value under a key in a forest, as @ref update_fn does
+//!        in a tree
+ErrorCode forest_update_fn(
+	Forest *forest, bkey_t key, update_fn_t fn, void *ctx
+);
+
+//! @brief Remove a key from a forest, as @ref erase does from a tree
+ErrorCode forest_erase(Forest *forest, bkey_t key);
+
+//! @brief Load a newly set up forest from entries already sorted by key
+//!
+//! Loads each tree's share of the entries with @ref bulk_load.
+//! @param[inout] forest  The forest to load, whose trees must be empty
+//! @param[in]    keys    Keys to load, in strictly increasing order
+//! @param[in]    values  Values corresponding to each key
+//! @param[in]    n       Number of entries to load
+//! @param[in]    fill    Target number of entries per node, as for
+//!                       @ref bulk_load
+//! @return An error code representing the success or type of failure of the
+//!         operation. Trees before the one which failed are left loaded.
+ErrorCode forest_bulk_load(
+	Forest *forest, bkey_t const *keys, bval_t const *values, size_t n,
+	li_t fill
+);
+
+//! @brief Visit entries of a forest in key order, as @ref scan does a tree
+//!
+//! Each tree's part of the range is scanned in turn, with the cursor moving
+//! on to the next tree as each is finished, so a scan may be paused and
+//! resumed across trees just as within one.
+//! @param[in]    forest  The forest to scan
+//! @param[inout] cursor  Scan position, advanced past every visited entry
+//! @param[in]    limit   Maximum number of entries to visit, 0 for no limit
+//! @param[in]    fn      Function to call on each entry
+//! @param[in]    ctx     Context pointer passed through to `fn`
+//! @param[out]   count   Number of entries visited, may be NULL
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode forest_scan(
+	Forest const *forest, ScanCursor *cursor, size_t limit,
+	scan_fn_t fn, void *ctx, size_t *count
+);
+
+#endif
@@ -47,8 +47,6 @@ ErrorCode insert_after_split(
 	} else {
 		status = insert_nonfull(&sibling->node, key, value);
 	}
-	mem_write_unlock(sibling);
-	mem_write_unlock(leaf);
 	return status;
 }
 
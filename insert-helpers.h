@@ -21,6 +21,8 @@ bkey_t max(Node const *node);
 ErrorCode insert_nonfull(Node *node, bkey_t key, bval_t value);
 
 //! @brief Insert new data into a node or its newly created sibling
+//!
+//! Neither node is written back; see split_node for the order to do so in.
 //! @return An error code representing the success or type of failure of the
 //!         operation
 ErrorCode insert_after_split(
@@ -28,9 +30,9 @@ ErrorCode insert_after_split(
 	bkey_t key,
 	//! [in] The value to insert
 	bval_t value,
-	//! [out] The original node to insert into
+	//! [inout] The original node to insert into
 	AddrNode *leaf,
-	//! [out] The new sibling to insert into
+	//! [inout] The new sibling to insert into
 	AddrNode *sibling
 );
 
@@ -1,5 +1,7 @@
 #include "insert.h"
+#include "alloc.h"
 #include "insert-helpers.h"
+#include "key-search.h"
 #include "memory.h"
 #include "node.h"
 #include "split.h"
@@ -7,62 +9,715 @@
 #include <string.h>
 
 
+//! @brief Most nodes that @ref insert_batch spreads one node's entries over
+#define BATCH_SPREAD (TREE_ORDER/2 > 3 ? TREE_ORDER/2 : 3)
+//! @brief Most entries that @ref insert_batch merges into one node at once
+#define BATCH_ENTRIES (BATCH_SPREAD * APPEND_SPLIT_KEEP)
+
+#if BATCH_SPREAD > TREE_ORDER
+#error "insert_batch needs a TREE_ORDER of at least 4"
+#endif
+#if defined(REDISTRIBUTE) && BATCH_ENTRIES < 2*TREE_ORDER + 1
+#error "REDISTRIBUTE needs room to merge two full nodes and a new entry"
+#endif
+
+
+//! @brief Sorted entries headed for one node, as merged by @ref insert_batch
+//!        or for a pair of siblings sharing their entries
+typedef struct {
+	bkey_t keys[BATCH_ENTRIES];
+	bval_t values[BATCH_ENTRIES];
+	size_t n;
+} Entries;
+
+
+//! @brief Add an entry to the end of a merge
+inline static void push_entry(Entries *e, bkey_t key, bval_t value) {
+	e->keys[e->n] = key;
+	e->values[e->n] = value;
+	++e->n;
+}
+
+
+//! @brief Fill a node with a run of merged entries
+static void fill_node(Node *node, Entries const *e, size_t from, size_t n) {
+	for (li_t i = 0; i < TREE_ORDER; ++i) {
+		if (i < n) {
+			node->keys[i] = e->keys[from + i];
+			node->values[i] = e->values[from + i];
+		} else {
+			node->keys[i] = INVALID;
+			node->values[i].data = INVALID;
+		}
+	}
+}
+
+
+//! @brief Lock the parent of a locked node
+//!
+//! Starts from the node one level up in @p lineage and moves right along that
+//! level, since the parent may have split since it was read, and records the
+//! parent found in its place. If that level is
+//! missing or the node no longer covers the child, because the parent was
+//! rebalanced or the lineage predates a new root, the lineage is traced again
+//! from the root.
+//! @return OUT_OF_MEMORY if the child was left without a parent by a split
+//!         which ran out of memory, otherwise an error code representing the
+//!         success or type of failure of the operation
+static ErrorCode lock_parent(
+	//! [in] Root of the tree the nodes reside in
+	bptr_t const *root,
+	//! [inout] Path to the child, refreshed if it turns out to be stale
+	bptr_t *lineage,
+	//! [in] The locked node whose parent to find
+	AddrNode const *child,
+	//! [out] The locked parent, or an INVALID address if the child is the root
+	AddrNode *parent
+) {
+	const uint_fast8_t level = get_level(child->addr) + 1;
+	const bkey_t key = max(&child->node);
+	ErrorCode status;
+	uint_fast8_t i;
+
+	for (;;) {
+		// Only a writer holding the root's lock can replace it, so this can't
+		// change underneath us
+		if (*root == child->addr) {
+			parent->addr = INVALID;
+			return SUCCESS;
+		}
+		parent->addr = INVALID;
+		for (i = 0; i < MAX_LEVELS; ++i) {
+			if (lineage[i] != INVALID && get_level(lineage[i]) == level) {
+				parent->addr = lineage[i];
+				break;
+			}
+		}
+		if (parent->addr != INVALID) {
+			parent->node = mem_read_lock(parent->addr);
+			if (move_right(parent, key)) {
+				if (find_child(&parent->node, child->addr) != TREE_ORDER) {
+					// Spare the next split below from moving this far right
+					lineage[i] = parent->addr;
+					return SUCCESS;
+				}
+				// The parent covers the child, and no split can be adding it
+				// while the parent is locked, so the child was split off by
+				// an insert which ran out of memory further up
+				mem_unlock(parent->addr);
+				return OUT_OF_MEMORY;
+			}
+		}
+		STATS_INC(restarts);
+		memset(lineage, INVALID, MAX_LEVELS*sizeof(bptr_t));
+		// Going any lower would mean validating the child, which we hold
+		status = trace_to_level(*root, key, level, lineage);
+		if (status != SUCCESS) return status;
+	}
+}
+
+
+//! @brief Trace the path to a key and lock the leaf covering it
+//! @return An error code representing the success or type of failure of the
+//!         operation
+static ErrorCode lock_leaf(
+	//! [in] Root of the tree to search
+	bptr_t const *root,
+	//! [in] The key whose leaf to lock
+	bkey_t key,
+	//! [out] Path to the leaf
+	bptr_t *lineage,
+	//! [out] The locked leaf
+	AddrNode *leaf
+) {
+	ErrorCode status;
+	memset(lineage, INVALID, MAX_LEVELS*sizeof(bptr_t));
+	do {
+		status = trace_lineage(*root, key, lineage);
+		if (status != SUCCESS) return status;
+		leaf->addr = lineage[get_leaf_idx(lineage)];
+		leaf->node = mem_read_lock(leaf->addr);
+		// The leaf may have changed since its parent was read
+	} while (!move_right(leaf, key));
+	return SUCCESS;
+}
+
+
+#ifdef REDISTRIBUTE
+//! @brief Make room for a key in a full node by sharing its entries with its
+//!        right sibling, B*-tree style
+//!
+//! If the entries of both nodes and the new one fit in two nodes, they are
+//! spread evenly over the pair, which only moves the separator between them
+//! in the parent. Otherwise the pair is split into three, which takes one new
+//! entry in the parent, so this is left to an ordinary split when the parent
+//! is full.
+//! @return SUCCESS once the key is stored and all three nodes have been
+//!         written back and unlocked. Otherwise nothing has been changed or
+//!         unlocked, and the node has to be split instead.
+static ErrorCode share_with_sibling(
+	//! [inout] The full node covering the key
+	AddrNode *node,
+	//! [inout] The node's right sibling
+	AddrNode *right,
+	//! [inout] The parent of both nodes
+	AddrNode *parent,
+	//! [in] The key to insert
+	bkey_t key,
+	//! [in] The value to insert
+	bval_t value
+) {
+	const li_t i = find_child(&parent->node, node->addr);
+	Entries e;
+	AddrNode middle;
+	size_t n_node, n_middle;
+	bool pending = true;
+	ErrorCode status;
+
+	// A sibling left without a parent entry, or under another parent, would
+	// need more than one separator moved
+	if (i+1 >= TREE_ORDER || parent->node.keys[i+1] == INVALID
+		|| parent->node.values[i+1].ptr != right->addr) {
+		return NOT_FOUND;
+	}
+
+	// The key is covered by the node, so it goes before any of the sibling's
+	e.n = 0;
+	for (li_t j = 0; j < TREE_ORDER; ++j) {
+		if (pending && key < node->node.keys[j]) {
+			push_entry(&e, key, value);
+			pending = false;
+		}
+		push_entry(&e, node->node.keys[j], node->node.values[j]);
+	}
+	if (pending) push_entry(&e, key, value);
+	// Keys past an inner node's last separator still lead to its last child,
+	// so that separator may lag behind the high key bounding the child. Here
+	// it stops being the last one.
+	if (!is_leaf(node->addr)) e.keys[e.n-1] = node->node.high_key;
+	for (li_t j = 0; j < TREE_ORDER && right->node.keys[j] != INVALID; ++j) {
+		push_entry(&e, right->node.keys[j], right->node.values[j]);
+	}
+	// Two full nodes and the new entry take three nodes, and the third one
+	// takes an entry in the parent
+	if (e.n > 2*TREE_ORDER) {
+		if (is_full(&parent->node)) return PARENT_FULL;
+		status = lock_empty_slot(get_level(node->addr),
+			get_region(node->addr), &middle, NULL, 0);
+		if (status != SUCCESS) return status;
+	}
+	// The same goes for the sibling's separator if it is the parent's last
+	// child. Separators placed below it must stay below it.
+	if (parent->node.keys[i+1] < e.keys[e.n-1]) {
+		parent->node.keys[i+1] = e.keys[e.n-1];
+	}
+
+	if (e.n <= 2*TREE_ORDER) {
+		// The sibling only gains entries, from the top of the node
+		n_node = (e.n + 1) / 2;
+		fill_node(&node->node, &e, 0, n_node);
+		fill_node(&right->node, &e, n_node, e.n - n_node);
+		node->node.high_key = e.keys[n_node-1];
+		right->node.low_key = node->node.high_key;
+		parent->node.keys[i] = node->node.high_key;
+		STATS_INC(shifts);
+		// Publish the sibling before the node stops covering what it took
+		mem_write_unlock(right);
+		mem_write_unlock(parent);
+		mem_write_unlock(node);
+		return SUCCESS;
+	}
+
+	STATS_INC(splits[get_level(node->addr)]);
+	n_node = e.n / 3 + (e.n % 3 > 0);
+	n_middle = e.n / 3 + (e.n % 3 > 1);
+	fill_node(&node->node, &e, 0, n_node);
+	fill_node(&middle.node, &e, n_node, n_middle);
+	fill_node(&right->node, &e, n_node + n_middle, e.n - n_node - n_middle);
+	middle.node.next = right->addr;
+	node->node.next = middle.addr;
+	node->node.high_key = e.keys[n_node-1];
+	middle.node.low_key = node->node.high_key;
+	middle.node.high_key = e.keys[n_node+n_middle-1];
+	right->node.low_key = middle.node.high_key;
+	parent->node.keys[i] = node->node.high_key;
+	insert_nonfull(&parent->node, middle.node.high_key,
+		(bval_t) {.ptr = middle.addr});
+	// Publish the new node before anything links to it, and the parent
+	// before the sibling stops covering the keys the new node took from it.
+	// Readers which went through the old parent see that it changed.
+	mem_write_unlock(&middle);
+	mem_write_unlock(parent);
+	mem_write_unlock(node);
+	mem_write_unlock(right);
+	return SUCCESS;
+}
+#endif
+
+
+//! @brief Insert a key which is not in a locked leaf, splitting as needed
+//!
+//! Unlocks the leaf, and anything else locked along the way, before
+//! returning.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+static ErrorCode insert_locked(
+	//! [inout] Root of the tree to insert into
+	bptr_t *root,
+	//! [inout] Path to the leaf, as traced by @ref lock_leaf
+	bptr_t *lineage,
+	//! [inout] The locked leaf covering the key, used as scratch space
+	AddrNode *leaf,
+	//! [in] The key to insert
+	bkey_t key,
+	//! [in] The value to insert
+	bval_t value
+) {
+	ErrorCode status;
+	AddrNode parent, sibling;
+#ifdef REDISTRIBUTE
+	AddrNode right;
+#endif
+	bool keep_splitting = false;
+
+	// Common case, only the leaf needs to be locked
+	if (!is_full(&leaf->node)) {
+		status = insert_nonfull(&leaf->node, key, value);
+		mem_write_unlock(leaf);
+		return status;
+	}
+
+	do {
+#ifdef REDISTRIBUTE
+		// Lock the right sibling ahead of the parent, in the same order as
+		// erase does, so that the node may share its entries with it
+		right.addr = leaf->node.next;
+		if (right.addr != INVALID) right.node = mem_read_lock(right.addr);
+#endif
+		// The node is full, so lock its parent to split it
+		status = lock_parent(root, lineage, leaf, &parent);
+		if (status != SUCCESS) {
+#ifdef REDISTRIBUTE
+			if (right.addr != INVALID) mem_unlock(right.addr);
+#endif
+			mem_unlock(leaf->addr);
+			return status;
+		}
+#ifdef REDISTRIBUTE
+		if (right.addr != INVALID) {
+			if (parent.addr != INVALID && share_with_sibling(
+					leaf, &right, &parent, key, value) == SUCCESS) {
+				// A pair split in three links the node to the new middle one
+				if (keep_splitting && leaf->node.next != right.addr) {
+					STATS_INC(parent_full);
+				}
+				return SUCCESS;
+			}
+			mem_unlock(right.addr);
+		}
+#endif
+
+		// Try to split this node
+		const bool new_root = (parent.addr == INVALID);
+		// Counted once the parent really splits, as it may make room
+		// otherwise
+		if (keep_splitting) STATS_INC(parent_full);
+		status = split_node(leaf, &parent, &sibling, key);
+		keep_splitting = (status == PARENT_FULL);
+		// Unrecoverable failure, nothing has been written
+		if (status != SUCCESS && status != PARENT_FULL) {
+			mem_unlock(leaf->addr);
+			if (parent.addr != INVALID) mem_unlock(parent.addr);
+			return status;
+		}
+		// Insert the new content
+		status = insert_after_split(key, value, leaf, &sibling);
+		// Publish the sibling before anything links to it, and the parent
+		// before the split node stops covering the sibling's keys
+		mem_write_unlock(&sibling);
+		if (!keep_splitting) {
+			mem_write_unlock(&parent);
+			if (new_root) *root = parent.addr;
+		}
+		mem_write_unlock(leaf);
+		if (keep_splitting) {
+			// Try this again on the parent
+			// The sibling takes over the old node's upper bound
+			const li_t i = find_child(&parent.node, leaf->addr);
+			key = max(&sibling.node);
+			if (parent.node.keys[i] > key) key = parent.node.keys[i];
+			rekey(&parent.node, parent.node.keys[i], max(&leaf->node));
+			value.ptr = sibling.addr;
+			*leaf = parent;
+		} else if (status != SUCCESS) {
+			return status;
+		}
+	} while (keep_splitting);
+
+	return SUCCESS;
+}
+
+
 ErrorCode insert(bptr_t *root, bkey_t key, bval_t value) {
 	ErrorCode status;
-	li_t i_leaf;
-	AddrNode leaf, parent, sibling;
+	AddrNode leaf;
 	bptr_t lineage[MAX_LEVELS];
-	bool keep_splitting = false;
 
-	// Initialize lineage array
-	memset(lineage, INVALID, MAX_LEVELS*sizeof(bptr_t));
-	// Try to trace lineage
-	status = trace_lineage(*root, key, lineage);
+	status = lock_leaf(root, key, lineage, &leaf);
 	if (status != SUCCESS) return status;
-	// Load leaf
-	i_leaf = get_leaf_idx(lineage);
-	leaf.addr = lineage[i_leaf];
-	leaf.node = mem_read_lock(leaf.addr);
-	do {
-		// Load this node's parent, if it exists
-		if (i_leaf > 0) {
-			parent.addr = lineage[i_leaf-1];
-			parent.node = mem_read_lock(parent.addr);
+	// Not worth splitting a full leaf for
+	if (first_eq(&leaf.node, key) != TREE_ORDER) {
+		mem_unlock(leaf.addr);
+		return KEY_EXISTS;
+	}
+	return insert_locked(root, lineage, &leaf, key, value);
+}
+
+
+ErrorCode update_fn(bptr_t *root, bkey_t key, update_fn_t fn, void *ctx) {
+	ErrorCode status;
+	AddrNode leaf;
+	bptr_t lineage[MAX_LEVELS];
+	bval_t value;
+	li_t i;
+
+	if (key == INVALID) return INVALID_ARGUMENT;
+	status = lock_leaf(root, key, lineage, &leaf);
+	if (status != SUCCESS) return status;
+	i = first_eq(&leaf.node, key);
+	// Existing keys are changed where they are, so nothing splits
+	if (i != TREE_ORDER) {
+		// Nodes may be packed, so the function gets a copy
+		value = leaf.node.values[i];
+		if (fn(&value, true, ctx)) {
+			leaf.node.values[i] = value;
+			mem_write_unlock(&leaf);
 		} else {
-			parent.addr = INVALID;
+			mem_unlock(leaf.addr);
 		}
+		return SUCCESS;
+	}
+	memset(&value, 0, sizeof(value));
+	if (!fn(&value, false, ctx)) {
+		mem_unlock(leaf.addr);
+		return NOT_FOUND;
+	}
+	return insert_locked(root, lineage, &leaf, key, value);
+}
 
-		if (!is_full(&leaf.node)) {
-			status = insert_nonfull(&leaf.node, key, value);
-			mem_write_unlock(&leaf);
-			if (parent.addr != INVALID) mem_unlock(parent.addr);
-			if (status != SUCCESS) return status;
+
+void finger_init(Finger *finger) {
+	memset(finger->lineage, INVALID, sizeof(finger->lineage));
+}
+
+
+//! @brief Lock the leaf cached in a finger, if it still covers a key
+//!
+//! Also accepts the leaf's right sibling, since once the leaf splits the keys
+//! that follow go there.
+//! @return Whether the leaf covering the key was locked
+static bool lock_finger_leaf(
+	//! [in] The finger whose leaf to lock
+	Finger const *finger,
+	//! [in] The key which the leaf must cover
+	bkey_t key,
+	//! [out] The locked leaf
+	AddrNode *leaf
+) {
+	const bptr_t addr = finger->lineage[get_leaf_idx(finger->lineage)];
+	Node next;
+
+	// The finger's path may have been traced again only partway down
+	if (addr == INVALID || !is_leaf(addr)) return false;
+	leaf->addr = addr;
+	leaf->node = mem_read_lock(addr);
+	if (past_high_key(&leaf->node, key)) {
+		STATS_INC(right_moves);
+		next = mem_read_lock(leaf->node.next);
+		mem_unlock(leaf->addr);
+		leaf->addr = leaf->node.next;
+		leaf->node = next;
+	}
+	// A leaf which was since emptied and retired covers nothing, and a slot
+	// which was never used would seem to cover everything
+	if (!is_valid(&leaf->node) || past_high_key(&leaf->node, key)
+		|| before_low_key(&leaf->node, key)) {
+		mem_unlock(leaf->addr);
+		return false;
+	}
+	return true;
+}
+
+
+ErrorCode append(bptr_t *root, Finger *finger, bkey_t key, bval_t value) {
+	ErrorCode status;
+	AddrNode leaf;
+	bptr_t *lineage = finger->lineage;
+
+	if (!lock_finger_leaf(finger, key, &leaf)) {
+		status = lock_leaf(root, key, lineage, &leaf);
+		if (status != SUCCESS) return status;
+	}
+	// Inner nodes on the path may be stale, which lock_parent copes with
+	lineage[get_leaf_idx(lineage)] = leaf.addr;
+	if (first_eq(&leaf.node, key) != TREE_ORDER) {
+		mem_unlock(leaf.addr);
+		return KEY_EXISTS;
+	}
+	return insert_locked(root, lineage, &leaf, key, value);
+}
+
+
+//! @brief Update function which stores the value pointed to by the context
+static bool store_value(bval_t *value, bool found, void *ctx) {
+	(void) found;
+	*value = *(bval_t const *) ctx;
+	return true;
+}
+
+
+ErrorCode upsert(bptr_t *root, bkey_t key, bval_t value) {
+	return update_fn(root, key, store_value, &value);
+}
+
+
+//! @brief Spread a locked node's merged entries over it and new siblings
+//!
+//! Nothing is written back. The siblings are locked and chained after the
+//! node, which keeps the first run of entries, with the last sibling taking
+//! over the node's upper bound. Runs are even, except when appending to the
+//! end of a level, where all but the last are APPEND_SPLIT_KEEP long.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+static ErrorCode spread_node(
+	//! [inout] The node whose entries to spread
+	AddrNode *node,
+	//! [in] Everything the node and its siblings should hold, in order
+	Entries const *e,
+	//! [in] Whether the entries are being appended to the end of a level
+	bool append,
+	//! [out] The locked siblings
+	AddrNode *siblings,
+	//! [out] Number of siblings
+	size_t *n_siblings
+) {
+	const size_t k = (e->n + APPEND_SPLIT_KEEP - 1) / APPEND_SPLIT_KEEP;
+	const bptr_t next = node->node.next;
+	const bkey_t high_key = node->node.high_key;
+	AddrNode *dest = node;
+	bptr_t held[BATCH_SPREAD];
+	size_t from = 0, n;
+	ErrorCode status;
+
+	// The node may be an empty root, and the siblings are empty until written
+	held[0] = node->addr;
+	for (size_t c = 0; c+1 < k; ++c) {
+		status = lock_empty_slot(get_level(node->addr),
+			get_region(node->addr), &siblings[c], held, c+1);
+		held[c+1] = siblings[c].addr;
+		if (status != SUCCESS) {
+			while (c-- > 0) {
+				mem_unlock(siblings[c].addr);
+				free_slot(siblings[c].addr);
+			}
+			return status;
+		}
+	}
+	STATS_INC(splits[get_level(node->addr)]);
+
+	for (size_t c = 0; c < k; ++c) {
+		if (append) {
+			n = (c+1 < k) ? APPEND_SPLIT_KEEP : e->n - from;
 		} else {
-			// Try to split this node
-			status = split_node(root, &leaf, &parent, &sibling);
-			keep_splitting = (status == PARENT_FULL);
-			// Unrecoverable failure
-			if (status != SUCCESS && status != PARENT_FULL) {
-				mem_unlock(leaf.addr);
-				mem_unlock(sibling.addr);
-				mem_unlock(parent.addr);
+			n = e->n / k + (c < e->n % k);
+		}
+		if (c > 0) {
+			dest->node.next = siblings[c-1].addr;
+			siblings[c-1].node.low_key = dest->node.high_key;
+			dest = &siblings[c-1];
+		}
+		fill_node(&dest->node, e, from, n);
+		from += n;
+		dest->node.high_key = e->keys[from-1];
+	}
+	dest->node.next = next;
+	dest->node.high_key = high_key;
+	*n_siblings = k-1;
+	return SUCCESS;
+}
+
+
+//! @brief Store merged entries in a locked node, splitting it as needed
+//!
+//! Splits cascade up the tree as in @ref insert_locked, except that a node
+//! may be spread over several siblings at once, which its parent then takes
+//! in a single update. Unlocks everything before returning.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+static ErrorCode store_entries(
+	//! [inout] Root of the tree to insert into
+	bptr_t *root,
+	//! [inout] Path to the node, as traced by @ref lock_leaf
+	bptr_t *lineage,
+	//! [inout] The locked node, used as scratch space
+	AddrNode *node,
+	//! [inout] Everything the node should hold, in order, used as scratch
+	//!         space
+	Entries *e,
+	//! [in] Whether the entries are being appended to the end of the leaves
+	bool append
+) {
+	AddrNode parent;
+	AddrNode siblings[BATCH_SPREAD];
+	size_t n_siblings;
+	ErrorCode status;
+	li_t i;
+
+	// Common case, only the leaf needs to be locked
+	if (e->n <= TREE_ORDER) {
+		fill_node(&node->node, e, 0, e->n);
+		mem_write_unlock(node);
+		return SUCCESS;
+	}
+
+	for (;;) {
+		append = append && node->node.next == INVALID;
+		status = lock_parent(root, lineage, node, &parent);
+		if (status != SUCCESS) {
+			mem_unlock(node->addr);
+			return status;
+		}
+		status = spread_node(node, e, append, siblings, &n_siblings);
+		if (status != SUCCESS) {
+			mem_unlock(node->addr);
+			if (parent.addr != INVALID) mem_unlock(parent.addr);
+			return status;
+		}
+
+		// Collect the parent's entries, with those of the spread nodes in
+		// place of the node's own
+		e->n = 0;
+		if (parent.addr == INVALID) {
+			status = lock_empty_slot(get_level(node->addr) + 1,
+				get_region(node->addr), &parent, NULL, 0);
+			if (status != SUCCESS) {
+				for (size_t c = 0; c < n_siblings; ++c) {
+					mem_unlock(siblings[c].addr);
+					free_slot(siblings[c].addr);
+				}
+				mem_unlock(node->addr);
 				return status;
 			}
-			// Insert the new content and unlock leaf and its sibling
-			status = insert_after_split(key, value, &leaf, &sibling);
-			if (keep_splitting) {
-				// Try this again on the parent
-				key = max(&sibling.node);
-				rekey(&parent.node, key, max(&leaf.node));
-				value.ptr = sibling.addr;
-				i_leaf--;
-				leaf = parent;
-			} else if (status != SUCCESS) {
-				mem_unlock(parent.addr);
-				return status;
+			STATS_INC(root_splits);
+			// The root is alone on its level and bounds nothing
+			parent.node.next = INVALID;
+			parent.node.low_key = INVALID;
+			parent.node.high_key = INVALID;
+			i = TREE_ORDER;
+		} else {
+			i = find_child(&parent.node, node->addr);
+			for (li_t j = 0; j < i; ++j) {
+				push_entry(e, parent.node.keys[j], parent.node.values[j]);
+			}
+		}
+		push_entry(e, node->node.high_key, (bval_t) {.ptr = node->addr});
+		for (size_t c = 0; c < n_siblings; ++c) {
+			push_entry(e, siblings[c].node.high_key,
+				(bval_t) {.ptr = siblings[c].addr});
+		}
+		// The last sibling takes over the node's upper bound
+		e->keys[e->n-1] = max(&siblings[n_siblings-1].node);
+		if (i < TREE_ORDER) {
+			if (parent.node.keys[i] > e->keys[e->n-1]) {
+				e->keys[e->n-1] = parent.node.keys[i];
+			}
+			for (li_t j = i+1; j < TREE_ORDER; ++j) {
+				if (parent.node.keys[j] == INVALID) break;
+				push_entry(e, parent.node.keys[j], parent.node.values[j]);
 			}
 		}
-	} while (keep_splitting);
 
-	return SUCCESS;
+		// Publish the siblings before anything links to them, and the parent
+		// before the spread node stops covering the siblings' keys
+		for (size_t c = 0; c < n_siblings; ++c) {
+			mem_write_unlock(&siblings[c]);
+		}
+		if (e->n <= TREE_ORDER) {
+			fill_node(&parent.node, e, 0, e->n);
+			mem_write_unlock(&parent);
+			if (i == TREE_ORDER) *root = parent.addr;
+			mem_write_unlock(node);
+			return SUCCESS;
+		}
+		// Try this again on the parent
+		STATS_INC(parent_full);
+		mem_write_unlock(node);
+		*node = parent;
+	}
+}
+
+
+ErrorCode insert_batch(
+	bptr_t *root, bkey_t const *keys, bval_t const *values, size_t n,
+	ErrorCode *statuses
+) {
+	Entries e;
+	ErrorCode status = SUCCESS;
+	AddrNode leaf;
+	bptr_t lineage[MAX_LEVELS];
+	bool append;
+	size_t j, first, room;
+	li_t i;
+
+	for (j = 0; j < n; ++j) {
+		if (keys[j] == INVALID || (j > 0 && keys[j] < keys[j-1])) {
+			for (j = 0; j < n; ++j) statuses[j] = INVALID_ARGUMENT;
+			return INVALID_ARGUMENT;
+		}
+	}
+
+	for (j = 0; j < n;) {
+		status = lock_leaf(root, keys[j], lineage, &leaf);
+		if (status != SUCCESS) break;
+		append = keys[j] > max(&leaf.node) && max(&leaf.node) != INVALID;
+		room = BATCH_ENTRIES - num_keys(&leaf.node);
+		first = j;
+
+		// Merge every key in the leaf's range into its entries
+		e.n = 0;
+		i = 0;
+		for (; j < n && j - first < room && !past_high_key(&leaf.node, keys[j]);
+			++j) {
+			while (i < TREE_ORDER && leaf.node.keys[i] < keys[j]) {
+				push_entry(&e, leaf.node.keys[i], leaf.node.values[i]);
+				++i;
+			}
+			if ((i < TREE_ORDER && leaf.node.keys[i] == keys[j])
+				|| (e.n > 0 && e.keys[e.n-1] == keys[j])) {
+				statuses[j] = KEY_EXISTS;
+			} else {
+				push_entry(&e, keys[j], values[j]);
+				statuses[j] = SUCCESS;
+			}
+		}
+		for (; i < TREE_ORDER && leaf.node.keys[i] != INVALID; ++i) {
+			push_entry(&e, leaf.node.keys[i], leaf.node.values[i]);
+		}
+
+		if (e.n == num_keys(&leaf.node)) {
+			mem_unlock(leaf.addr);
+			continue;
+		}
+		status = store_entries(root, lineage, &leaf, &e, append);
+		if (status != SUCCESS) {
+			for (size_t k = first; k < j; ++k) {
+				if (statuses[k] == SUCCESS) statuses[k] = status;
+			}
+			break;
+		}
+	}
+
+	// Anything not reached failed along with the key that stopped the batch
+	for (; j < n; ++j) statuses[j] = status;
+	return status;
 }
@@ -2,8 +2,16 @@
 #define INSERT_H
 
 #include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 //! @brief Insert a new value into the tree with the given key and value
+//!
+//! Built with `-DREDISTRIBUTE`, a full node first tries to make room by
+//! shifting entries into its right sibling, and a full pair of siblings
+//! splits into three nodes rather than one splitting into two. Nodes are
+//! then left about two thirds full or more, rather than half, and fewer
+//! splits reach the parent.
 //! @param[inout] root   The address of the root of the tree to insert into
 //! @param[in]    key    The key under which the value should be inserted
 //! @param[in]    value  The value to insert
@@ -11,4 +19,89 @@
 //!         operation
 ErrorCode insert(bptr_t *root, bkey_t key, bval_t value);
 
+//! @brief Insert a key and value, or replace the value if the key exists
+//! @param[inout] root   The address of the root of the tree to insert into
+//! @param[in]    key    The key under which the value should be stored
+//! @param[in]    value  The value to store
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode upsert(bptr_t *root, bkey_t key, bval_t value);
+
+//! @brief Function applied to a value by @ref update_fn
+//!
+//! Runs while the leaf holding the key is locked, so it should be short and
+//! must not operate on the tree itself.
+//! @param[inout] value  The key's value, or a zeroed value for a key which is
+//!                      not in the tree yet
+//! @param[in]    found  Whether the key is already in the tree
+//! @param[in]    ctx    Caller-supplied context pointer
+//! @return True to store the value, false to leave the tree unchanged
+typedef bool (*update_fn_t)(bval_t *value, bool found, void *ctx);
+
+//! @brief Atomically read, modify and write the value under a key
+//!
+//! Takes a single traversal. A key already in the tree has its value changed
+//! in place, which never splits a node; a new key is inserted as by
+//! @ref insert if the function asks for it to be stored.
+//! @param[inout] root  The address of the root of the tree to update
+//! @param[in]    key   The key whose value to update
+//! @param[in]    fn    Function to apply to the value
+//! @param[in]    ctx   Context pointer passed through to `fn`
+//! @return NOT_FOUND if the key was not in the tree and `fn` declined to add
+//!         it, otherwise an error code representing the success or type of
+//!         failure of the operation
+ErrorCode update_fn(bptr_t *root, bkey_t key, update_fn_t fn, void *ctx);
+
+//! @brief Insert a sorted batch of keys and values
+//!
+//! Traces the tree once for each leaf the keys fall into, and merges all of
+//! that leaf's keys in one pass under its lock. A leaf given more keys than
+//! it can hold is spread over as many new siblings as needed at once, and
+//! its parent takes them all in a single update, splitting in turn if need
+//! be. Keys already in the tree, or repeated within the batch, are left as
+//! they are.
+//! @param[inout] root      The address of the root of the tree to insert into
+//! @param[in]    keys      The keys to insert, in ascending order
+//! @param[in]    values    The value to insert under each key
+//! @param[in]    n         Number of keys to insert
+//! @param[out]   statuses  Outcome of inserting each key, as @ref insert
+//!                         would return it
+//! @return INVALID_ARGUMENT, without inserting anything, if the keys are out
+//!         of order, otherwise SUCCESS unless an error stopped the batch, in
+//!         which case the keys not reached are given that error as well
+ErrorCode insert_batch(
+	bptr_t *root, bkey_t const *keys, bval_t const *values, size_t n,
+	ErrorCode *statuses
+);
+
+//! @brief Cached path to the leaf that the last key appended through it went to
+//!
+//! Kept by each thread appending keys, and initialized with
+//! @ref finger_init before first use and whenever the tree's memory is reset.
+typedef struct {
+	bptr_t lineage[MAX_LEVELS];
+} Finger;
+
+//! @brief Empty a finger, so that the next append through it starts from the
+//!        root
+//! @param[out] finger  The finger to initialize
+void finger_init(Finger *finger);
+
+//! @brief Insert a key, starting from the leaf the last key went to
+//!
+//! Behaves as @ref insert, but goes straight to the leaf cached in the finger
+//! if that leaf, or the sibling it most recently split off, covers the key.
+//! Only when neither does is the path traced from the root again. Suited to
+//! keys which mostly increase, such as timestamps, where each key lands in
+//! the rightmost leaf; such leaves split unevenly, as @ref split_node
+//! describes, so that the tree fills up densely.
+//! @param[inout] root    The address of the root of the tree to insert into
+//! @param[inout] finger  Path to the last leaf appended to, updated to the
+//!                       leaf this key goes to
+//! @param[in]    key     The key under which the value should be inserted
+//! @param[in]    value   The value to insert
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode append(bptr_t *root, Finger *finger, bkey_t key, bval_t value);
+
 #endif
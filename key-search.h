@@ -0,0 +1,127 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+//! @file key-search.h
+//! @brief Search kernels over a node's key array
+//!
+//! Each kernel compares as many keys at a time as the widest vector
+//! extension enabled at compile time allows (AVX-512, AVX2, then SSE2),
+//! handing any keys left over to the next narrower kernel and finally a
+//! scalar loop. Building with `-DSCALAR_KEY_SEARCH`, for synthesis or for
+//! targets without these extensions leaves only the scalar loop.
+
+
+#include "node.h"
+
+#if !defined(__SYNTHESIS__) && !defined(SCALAR_KEY_SEARCH) \
+	&& (defined(__SSE2__) || defined(__AVX2__) || defined(__AVX512F__))
+	#define VECTOR_KEY_SEARCH
+	#include <immintrin.h>
+#endif
+
+
+#ifdef VECTOR_KEY_SEARCH
+//! @brief Flip the sign bit so that signed comparisons order keys as unsigned
+#define KEY_BIAS ((int) 0x80000000)
+#endif
+
+
+//! @brief Find the first key which is greater than or equal to a given key
+//!
+//! Since @ref INVALID is the largest possible key, unused slots always
+//! compare greater than or equal.
+//! @param[in] n    The node whose keys to search
+//! @param[in] key  The key to compare against
+//! @return Index of the first such key, or TREE_ORDER if there is none
+inline static li_t first_geq(Node const *n, bkey_t key) {
+	li_t i = 0;
+#if defined(VECTOR_KEY_SEARCH) && defined(__AVX512F__)
+	{
+		const __m512i needle = _mm512_set1_epi32((int) key);
+		for (; i + 16 <= TREE_ORDER; i += 16) {
+			const __m512i k = _mm512_loadu_si512((void const *) (n->keys + i));
+			const __mmask16 m = _mm512_cmpge_epu32_mask(k, needle);
+			if (m) return i + __builtin_ctz(m);
+		}
+	}
+#endif
+#if defined(VECTOR_KEY_SEARCH) && defined(__AVX2__)
+	{
+		const __m256i bias = _mm256_set1_epi32(KEY_BIAS);
+		const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32((int) key), bias);
+		for (; i + 8 <= TREE_ORDER; i += 8) {
+			const __m256i k = _mm256_xor_si256(
+				_mm256_loadu_si256((__m256i const *) (n->keys + i)), bias);
+			// Lanes where the key is less than the needle
+			const unsigned lt = _mm256_movemask_ps(
+				_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, k)));
+			if (lt != 0xFF) return i + __builtin_ctz(~lt);
+		}
+	}
+#endif
+#ifdef VECTOR_KEY_SEARCH
+	{
+		const __m128i bias = _mm_set1_epi32(KEY_BIAS);
+		const __m128i needle = _mm_xor_si128(_mm_set1_epi32((int) key), bias);
+		for (; i + 4 <= TREE_ORDER; i += 4) {
+			const __m128i k = _mm_xor_si128(
+				_mm_loadu_si128((__m128i const *) (n->keys + i)), bias);
+			const unsigned lt = _mm_movemask_ps(
+				_mm_castsi128_ps(_mm_cmpgt_epi32(needle, k)));
+			if (lt != 0xF) return i + __builtin_ctz(~lt);
+		}
+	}
+#endif
+	for (; i < TREE_ORDER; ++i) {
+		if (n->keys[i] >= key) return i;
+	}
+	return TREE_ORDER;
+}
+
+
+//! @brief Find the first key which is equal to a given key
+//! @param[in] n    The node whose keys to search
+//! @param[in] key  The key to compare against
+//! @return Index of the first such key, or TREE_ORDER if there is none
+inline static li_t first_eq(Node const *n, bkey_t key) {
+	li_t i = 0;
+#if defined(VECTOR_KEY_SEARCH) && defined(__AVX512F__)
+	{
+		const __m512i needle = _mm512_set1_epi32((int) key);
+		for (; i + 16 <= TREE_ORDER; i += 16) {
+			const __m512i k = _mm512_loadu_si512((void const *) (n->keys + i));
+			const __mmask16 m = _mm512_cmpeq_epu32_mask(k, needle);
+			if (m) return i + __builtin_ctz(m);
+		}
+	}
+#endif
+#if defined(VECTOR_KEY_SEARCH) && defined(__AVX2__)
+	{
+		const __m256i needle = _mm256_set1_epi32((int) key);
+		for (; i + 8 <= TREE_ORDER; i += 8) {
+			const __m256i k = _mm256_loadu_si256((__m256i const *) (n->keys + i));
+			const unsigned eq = _mm256_movemask_ps(
+				_mm256_castsi256_ps(_mm256_cmpeq_epi32(k, needle)));
+			if (eq) return i + __builtin_ctz(eq);
+		}
+	}
+#endif
+#ifdef VECTOR_KEY_SEARCH
+	{
+		const __m128i needle = _mm_set1_epi32((int) key);
+		for (; i + 4 <= TREE_ORDER; i += 4) {
+			const __m128i k = _mm_loadu_si128((__m128i const *) (n->keys + i));
+			const unsigned eq = _mm_movemask_ps(
+				_mm_castsi128_ps(_mm_cmpeq_epi32(k, needle)));
+			if (eq) return i + __builtin_ctz(eq);
+		}
+	}
+#endif
+	for (; i < TREE_ORDER; ++i) {
+		if (n->keys[i] == key) return i;
+	}
+	return TREE_ORDER;
+}
+
+
+#endif
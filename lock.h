@@ -1,27 +1,37 @@
 #ifndef LOCK_H
 #define LOCK_H
 
+#include "stats.h"
 #include <assert.h>
+#ifndef __cplusplus
+	#include <stdbool.h>
+#endif
 
+//! Locks default to the single-threaded C simulation model shared with the
+//! HLS flow. Host builds that run the tree from several threads instead pass
+//! `-DATOMIC_LOCKS` to get real atomic test-and-set.
+#ifndef ATOMIC_LOCKS
 #define CSIM
+#endif
 #if defined(CSIM)
-	#ifndef __cplusplus
-		#include <stdbool.h>
-	#endif
 	typedef bool lock_t;
 #elif defined(__SYNTHESIS__)
 	#include <ap_cint.h>
 	typedef uint1 lock_t;
 	#define TEST_AND_SET(lockptr) ((*lockptr) == 1)
 #else
-	#ifdef(__cplusplus)
+	#ifdef __cplusplus
 		#include <atomic>
-		typedef std::atomic_flag lock_t;
+		// A plain byte, as std::atomic_flag would stop C++ from packing
+		// nodes the same way as C
+		typedef bool lock_t;
+		typedef std::atomic<bver_t> atomic_ver_t;
 		#define TEST_AND_SET(lockptr) \
-			((lockptr)->test_and_set(std::memory_order_acquire))
+			(__atomic_test_and_set((lockptr), __ATOMIC_ACQUIRE))
 	#else
 		#include <stdatomic.h>
 		typedef atomic_flag lock_t;
+		typedef _Atomic bver_t atomic_ver_t;
 		#define TEST_AND_SET(lockptr) (atomic_flag_test_and_set(lockptr))
 	#endif
 #endif
@@ -34,7 +44,7 @@ static inline bool test_and_set(lock_t *lock) {
 	*lock = true;
 	return old;
 #elif defined(__cplusplus)
-	return lock->test_and_set(std::memory_order_acquire);
+	return __atomic_test_and_set(lock, __ATOMIC_ACQUIRE);
 #else
 	return atomic_flag_test_and_set(lock);
 #endif
@@ -44,8 +54,10 @@ static inline bool test_and_set(lock_t *lock) {
 static inline void init_lock(lock_t *lock) {
 #if defined(CSIM) || defined(__SYNTHESIS__)
 	*lock = 0;
-#elif !defined(__cplusplus)
-	*lock = ATOMIC_FLAG_INIT;
+#elif defined(__cplusplus)
+	__atomic_clear(lock, __ATOMIC_RELEASE);
+#else
+	atomic_flag_clear(lock);
 #endif
 }
 
@@ -57,9 +69,38 @@ static inline bool lock_test(lock_t const *lock) {
 }
 
 
+//! @brief Upper bound on the number of pause iterations between attempts to
+//!        take a contended lock
+#ifndef LOCK_MAX_BACKOFF
+#define LOCK_MAX_BACKOFF (1024)
+#endif
+
+//! @brief Hint to the processor that this is a spin-wait loop
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+
 //! @brief Set the given lock to held
 static inline void lock_p(lock_t *lock) {
-	while (test_and_set(lock));
+	STATS_INC(lock_acquires);
+#if defined(CSIM) || defined(__SYNTHESIS__)
+	while (test_and_set(lock)) STATS_INC(lock_spins);
+#else
+	// Exponential backoff keeps waiters from hammering the lock's cache line
+	// with read-modify-write operations while it is held
+	for (unsigned backoff = 1; test_and_set(lock);) {
+		STATS_INC(lock_spins);
+		for (unsigned i = 0; i < backoff; ++i) {
+			cpu_relax();
+		}
+		if (backoff < LOCK_MAX_BACKOFF) backoff <<= 1;
+	}
+#endif
 }
 
 //! @brief Release the given lock
@@ -68,7 +109,7 @@ static inline void lock_v(lock_t *lock) {
 #if defined(CSIM) || defined(__SYNTHESIS__)
 	*lock = 0;
 #elif defined(__cplusplus)
-	lock->clear(std::memory_order_release);
+	__atomic_clear(lock, __ATOMIC_RELEASE);
 #else
 	atomic_flag_clear(lock);
 #endif
@@ -0,0 +1,91 @@
+//! @file memory-host.c
+//! @brief Multithreaded host implementation of @ref memory.h
+//!
+//! Backs the tree with a single shared array of nodes and guards each node
+//! with an atomic lock, so any number of host threads may operate on the tree
+//! concurrently. Each node also has a seqlock-style version so that lock-free
+//! readers always copy a consistent snapshot and can validate nodes they have
+//! already passed through. Selected at build time by compiling this file in
+//! place of any other memory backend along with `-DATOMIC_LOCKS`. Building
+//! with `-DNODE_CACHE` as well, along with node-cache.c, serves reads from
+//! @ref node-cache.h where it can, and with `-DMEM_TRACE` and memory-trace.c,
+//! records accesses as described in @ref memory-trace.h. Access to each node
+//! goes through @ref memory-slot.h, shared with memory-mmap.c.
+
+#include "memory.h"
+#include "memory-slot.h"
+#include <stdatomic.h>
+
+#ifndef ATOMIC_LOCKS
+#error "memory-host.c requires ATOMIC_LOCKS to be defined for all sources"
+#endif
+
+
+//! @brief Shared node storage for the whole tree
+static Node memory[MEM_SIZE];
+#ifndef ALIGNED_NODES
+//! @brief Seqlock counter for each node, odd while the node is being written
+static _Atomic bver_t versions[MEM_SIZE];
+#endif
+
+
+//! @brief Seqlock counter of a node, kept beside its lock in aligned layouts
+static inline _Atomic bver_t *version_of(bptr_t address) {
+#ifdef ALIGNED_NODES
+	return &memory[address].version;
+#else
+	return &versions[address];
+#endif
+}
+
+
+Node mem_read(bptr_t address) {
+	bver_t version;
+	return mem_read_versioned(address, &version);
+}
+
+
+Node mem_read_versioned(bptr_t address, bver_t *version) {
+	return slot_read_versioned(
+		address, &memory[address], version_of(address), version);
+}
+
+
+bool mem_validate(bptr_t address, bver_t version) {
+	return slot_validate(&memory[address], version_of(address), version);
+}
+
+
+Node mem_read_lock(bptr_t address) {
+	return slot_read_lock(address, &memory[address], version_of(address));
+}
+
+
+void mem_write_unlock(AddrNode *node) {
+	slot_write_unlock(node, &memory[node->addr], version_of(node->addr));
+}
+
+
+void mem_unlock(bptr_t address) {
+	slot_unlock(address, &memory[address]);
+}
+
+
+void mem_prefetch(bptr_t address) {
+	slot_prefetch(&memory[address]);
+}
+
+
+void mem_reset_all() {
+	for (bptr_t i = 0; i < MEM_SIZE; ++i) {
+		slot_reset(&memory[i], version_of(i));
+	}
+#ifdef NODE_CACHE
+	node_cache_clear();
+#endif
+}
+
+
+bptr_t ptr_to_addr(void *ptr) {
+	return (Node *) ptr - memory;
+}
@@ -0,0 +1,302 @@
+//! @file memory-mmap.c
+//! @brief Persistent host implementation of @ref memory.h over a mapped file
+//!
+//! Works like memory-host.c, with atomic locks and seqlock versions, except
+//! that the node grid lives in a file mapped with `mmap`. The file starts
+//! with a small header that records the geometry it was built with and the
+//! root of the tree, followed by the grid itself and, with `-DELASTIC_LEVELS`,
+//! the level each chunk of the grid belongs to. Restarting is a matter of
+//! mapping the file again; see @ref memory-mmap.h for opening, checkpointing
+//! and closing it. Versions only need to be consistent within one process, so
+//! they are kept in memory unless the node layout places them inside each
+//! node. Selected at build time by compiling this file in place of any other
+//! memory backend along with `-DATOMIC_LOCKS`.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "memory.h"
+#include "memory-mmap.h"
+#include "memory-slot.h"
+#ifdef ELASTIC_LEVELS
+#include "alloc.h"
+#endif
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef ATOMIC_LOCKS
+#error "memory-mmap.c requires ATOMIC_LOCKS to be defined for all sources"
+#endif
+
+
+//! @brief Identifies a tree file and the version of its format
+#define FILE_MAGIC "BLNKTRE2"
+//! @brief Offset of the node grid within the file, keeping it page aligned
+#define GRID_OFFSET 4096
+//! @brief Size of the chunks handed out to levels, recorded as 0 for fixed
+//!        levels
+#ifdef ELASTIC_LEVELS
+#define FILE_CHUNK_SIZE LEVEL_CHUNK_SIZE
+//! @brief Number of chunk tags kept after the grid
+#define FILE_CHUNKS (MEM_SIZE / LEVEL_CHUNK_SIZE)
+#else
+#define FILE_CHUNK_SIZE 0
+#endif
+
+
+//! @brief Start of the tree file
+typedef struct {
+	char magic[8];
+	//! @brief Geometry and layout the file was created with, which must
+	//!        match the current build
+	uint32_t tree_order;
+	uint32_t nodes_per_level;
+	uint32_t levels;
+	uint32_t node_size;
+	uint32_t key_size;
+	uint32_t level_chunk_size;
+	uint32_t mem_regions;
+	//! @brief Nonzero while a process has the file open, so that a crash can
+	//!        be detected on the next open
+	uint32_t in_use;
+	//! @brief Root of the tree
+	bptr_t root;
+} FileHeader;
+
+_Static_assert(sizeof(FileHeader) <= GRID_OFFSET, "Header overlaps grid");
+
+
+//! @brief Descriptor of the open file, or -1
+static int file = -1;
+//! @brief Start of the mapping, where the header lives
+static FileHeader *header;
+//! @brief Node storage for the whole tree, within the mapping
+static Node *memory;
+#ifndef ALIGNED_NODES
+//! @brief Seqlock counter for each node, odd while the node is being written
+static _Atomic bver_t *versions;
+#endif
+
+
+//! @brief Seqlock counter of a node, kept beside its lock in aligned layouts
+static inline _Atomic bver_t *version_of(bptr_t address) {
+#ifdef ALIGNED_NODES
+	return &memory[address].version;
+#else
+	return &versions[address];
+#endif
+}
+
+
+//! @brief Size of the file and of its mapping
+static size_t file_size() {
+	const size_t size = GRID_OFFSET + (size_t) MEM_SIZE * sizeof(Node);
+#ifdef ELASTIC_LEVELS
+	return size + FILE_CHUNKS;
+#else
+	return size;
+#endif
+}
+
+#ifdef ELASTIC_LEVELS
+//! @brief Copy of the allocator's chunk tags, within the mapping after the
+//!        grid, as of the last checkpoint
+static uint8_t *file_tags() {
+	return (uint8_t *) &memory[MEM_SIZE];
+}
+
+//! @brief Restore the allocator's chunk tags, which @ref get_level needs
+//!        before any node can be reached
+//! @param[in] saved  Whether the tags in the file are up to date, as when it
+//!                   was closed cleanly. Otherwise chunks may have been given
+//!                   to levels since the last checkpoint, and the tags are
+//!                   worked out again from the nodes.
+static void load_tags(bool saved) {
+	if (!saved) {
+		alloc_rebuild();
+		return;
+	}
+	for (bptr_t c = 0; c < FILE_CHUNKS; ++c) chunk_tags[c] = file_tags()[c];
+}
+#endif
+
+//! @brief Give up on a partially opened file
+static ErrorCode abandon(ErrorCode status) {
+	if (header) munmap(header, file_size());
+	if (file >= 0) close(file);
+#ifndef ALIGNED_NODES
+	free(versions);
+	versions = NULL;
+#endif
+	header = NULL;
+	memory = NULL;
+	file = -1;
+	return status;
+}
+
+
+ErrorCode mem_open(char const *path) {
+	static const char blank[sizeof(header->magic)] = {0};
+	struct stat st;
+	struct flock exclusive = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+	bool created;
+	void *map;
+
+	if (file >= 0) return INVALID_ARGUMENT;
+	file = open(path, O_RDWR | O_CREAT, 0644);
+	if (file < 0) return IO_ERROR;
+	// Locks and versions are only shared within this process
+	if (fcntl(file, F_SETLK, &exclusive) != 0) return abandon(IO_ERROR);
+	if (fstat(file, &st) != 0) return abandon(IO_ERROR);
+	created = (st.st_size == 0);
+	if (created) {
+		if (ftruncate(file, file_size()) != 0) return abandon(IO_ERROR);
+	} else if ((size_t) st.st_size != file_size()) {
+		return abandon(INVALID_ARGUMENT);
+	}
+
+	map = mmap(NULL, file_size(), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (map == MAP_FAILED) return abandon(IO_ERROR);
+	header = map;
+	memory = (Node *) ((char *) map + GRID_OFFSET);
+#ifndef ALIGNED_NODES
+	// Large zeroed allocations are mapped lazily, so this is cheap too
+	versions = calloc(MEM_SIZE, sizeof(*versions));
+	if (!versions) return abandon(OUT_OF_MEMORY);
+#endif
+
+#ifdef NODE_CACHE
+	// Versions start over with every mapping
+	node_cache_clear();
+#endif
+
+	// A process which died creating the file may have left it without a
+	// magic number, and nothing else in it is of any use
+	if (!created && !memcmp(header->magic, blank, sizeof(header->magic))) {
+		created = true;
+	}
+
+	if (created) {
+		header->tree_order = TREE_ORDER;
+		header->nodes_per_level = MAX_NODES_PER_LEVEL;
+		header->levels = MAX_LEVELS;
+		header->node_size = sizeof(Node);
+		header->key_size = sizeof(bkey_t);
+		header->level_chunk_size = FILE_CHUNK_SIZE;
+		header->mem_regions = MEM_REGIONS;
+		mem_reset_all();
+#ifdef ELASTIC_LEVELS
+		// Forget the levels of any file mapped before
+		load_tags(false);
+#endif
+		// Only mark the file as a tree once the rest of it is on disk
+		if (mem_checkpoint() != SUCCESS) return abandon(IO_ERROR);
+		memcpy(header->magic, FILE_MAGIC, sizeof(header->magic));
+	} else {
+		if (memcmp(header->magic, FILE_MAGIC, sizeof(header->magic))
+			|| header->tree_order != TREE_ORDER
+			|| header->nodes_per_level != MAX_NODES_PER_LEVEL
+			|| header->levels != MAX_LEVELS
+			|| header->node_size != sizeof(Node)
+			|| header->key_size != sizeof(bkey_t)
+			|| header->level_chunk_size != FILE_CHUNK_SIZE
+			|| header->mem_regions != MEM_REGIONS) {
+			return abandon(INVALID_ARGUMENT);
+		}
+		// The last process to use the file died, possibly holding locks or
+		// partway through a write
+		if (header->in_use) {
+			for (bptr_t i = 0; i < MEM_SIZE; ++i) {
+				init_lock(&memory[i].lock);
+				atomic_store(version_of(i), 0);
+			}
+		}
+#ifdef ELASTIC_LEVELS
+		load_tags(!header->in_use);
+#endif
+	}
+	header->in_use = 1;
+	return mem_checkpoint();
+}
+
+
+ErrorCode mem_checkpoint() {
+	if (!header) return INVALID_ARGUMENT;
+#ifdef ELASTIC_LEVELS
+	for (bptr_t c = 0; c < FILE_CHUNKS; ++c) file_tags()[c] = chunk_tags[c];
+#endif
+	return (msync(header, file_size(), MS_SYNC) == 0) ? SUCCESS : IO_ERROR;
+}
+
+
+ErrorCode mem_close() {
+	ErrorCode status;
+	if (!header) return INVALID_ARGUMENT;
+	header->in_use = 0;
+	status = mem_checkpoint();
+	abandon(SUCCESS);
+	return status;
+}
+
+
+bptr_t *mem_root() {
+	return &header->root;
+}
+
+
+Node mem_read(bptr_t address) {
+	bver_t version;
+	return mem_read_versioned(address, &version);
+}
+
+
+Node mem_read_versioned(bptr_t address, bver_t *version) {
+	return slot_read_versioned(
+		address, &memory[address], version_of(address), version);
+}
+
+
+bool mem_validate(bptr_t address, bver_t version) {
+	return slot_validate(&memory[address], version_of(address), version);
+}
+
+
+Node mem_read_lock(bptr_t address) {
+	return slot_read_lock(address, &memory[address], version_of(address));
+}
+
+
+void mem_write_unlock(AddrNode *node) {
+	slot_write_unlock(node, &memory[node->addr], version_of(node->addr));
+}
+
+
+void mem_unlock(bptr_t address) {
+	slot_unlock(address, &memory[address]);
+}
+
+
+void mem_prefetch(bptr_t address) {
+	slot_prefetch(&memory[address]);
+}
+
+
+void mem_reset_all() {
+	for (bptr_t i = 0; i < MEM_SIZE; ++i) {
+		slot_reset(&memory[i], version_of(i));
+	}
+#ifdef NODE_CACHE
+	node_cache_clear();
+#endif
+	header->root = 0;
+}
+
+
+bptr_t ptr_to_addr(void *ptr) {
+	return (Node *) ptr - memory;
+}
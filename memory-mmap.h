@@ -0,0 +1,49 @@
+#ifndef MEMORY_MMAP_H
+#define MEMORY_MMAP_H
+
+
+#include "types.h"
+
+
+//! @brief Map a tree file into memory, creating it if it does not exist
+//!
+//! Reopening a cleanly closed file only maps it and, with `-DELASTIC_LEVELS`,
+//! restores the level of each chunk of memory saved with it, so it is quick
+//! however large the tree is, and @ref alloc_rebuild need not be called. If
+//! the file was not closed cleanly, every node's lock is released, since
+//! whoever held it is gone, and with `-DELASTIC_LEVELS` the chunks' levels are
+//! worked out again from the nodes, which takes time in proportion to the
+//! size of memory. A file left behind by a process which died creating it is
+//! set up afresh. The file must have been created with the same geometry,
+//! node layout, level chunk size and number of regions as this build. Only
+//! one process may have a file open at a time.
+//! @param[in] path  File to back the tree with
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode mem_open(char const *path);
+
+//! @brief Flush the whole tree to its file, along with the level of each
+//!        chunk of memory with `-DELASTIC_LEVELS`
+//!
+//! Writers should be paused for the file to hold a consistent tree.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode mem_checkpoint();
+
+//! @brief Checkpoint and unmap the tree
+//!
+//! No operations may be in progress. The file is marked as cleanly closed so
+//! that the next @ref mem_open can skip resetting locks.
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode mem_close();
+
+//! @brief Root of the tree stored in the file
+//!
+//! Pass this to tree operations in place of a root variable so that the root
+//! persists along with the nodes.
+//! @return Pointer into the mapped file header, valid until @ref mem_close
+bptr_t *mem_root();
+
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef MEMORY_SLOT_H
+#define MEMORY_SLOT_H
+
+//! @file memory-slot.h
+//! @brief Access to one node of a host memory backend's grid
+//!
+//! memory-host.c and memory-mmap.c differ only in where the grid lives, so
+//! both implement @ref memory.h by passing these the node at an address and
+//! its seqlock version. Each node is guarded by its atomic lock and version,
+//! reads go through @ref node-cache.h with `-DNODE_CACHE`, and accesses are
+//! recorded as described in @ref memory-trace.h with `-DMEM_TRACE`.
+
+#include "memory-trace.h"
+#include "node.h"
+#ifdef NODE_CACHE
+#include "node-cache.h"
+#endif
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+
+//! @brief See @ref mem_read_versioned
+static inline Node slot_read_versioned(
+	bptr_t address, Node const *slot, _Atomic bver_t *slot_version,
+	bver_t *version
+) {
+	Node node;
+	STATS_INC(node_reads);
+	MEM_TRACE_RECORD(TRACE_READ, address);
+	for (;;) {
+		*version = atomic_load_explicit(slot_version, memory_order_acquire);
+		if (*version & 1) {
+			STATS_INC(read_retries);
+			cpu_relax();
+			continue;
+		}
+#ifdef NODE_CACHE
+		if (node_cache_read(address, *version, &node)) return node;
+#endif
+		memcpy(&node, slot, offsetof(Node, lock));
+		// Retry if a writer started while the node was being copied
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(slot_version, memory_order_relaxed)
+			== *version) {
+#ifdef NODE_CACHE
+			node_cache_fill(address, *version, &node);
+#endif
+			return node;
+		}
+		STATS_INC(read_retries);
+	}
+}
+
+//! @brief See @ref mem_validate
+static inline bool slot_validate(
+	Node const *slot, _Atomic bver_t *slot_version, bver_t version
+) {
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(slot_version, memory_order_relaxed) == version
+		&& !lock_test(&slot->lock);
+}
+
+//! @brief See @ref mem_read_lock
+static inline Node slot_read_lock(
+	bptr_t address, Node *slot, _Atomic bver_t *slot_version
+) {
+	Node node;
+	lock_p(&slot->lock);
+	STATS_INC(node_reads);
+	MEM_TRACE_RECORD(TRACE_READ_LOCK, address);
+#ifdef NODE_CACHE
+	// Nothing else can write the node while it is locked
+	if (node_cache_read(address, atomic_load_explicit(
+			slot_version, memory_order_relaxed), &node)) {
+		return node;
+	}
+#else
+	(void) slot_version;
+#endif
+	memcpy(&node, slot, offsetof(Node, lock));
+	return node;
+}
+
+//! @brief See @ref mem_write_unlock
+static inline void slot_write_unlock(
+	AddrNode const *node, Node *slot, _Atomic bver_t *slot_version
+) {
+	const bver_t old = atomic_load_explicit(slot_version, memory_order_relaxed);
+
+	STATS_INC(node_writes);
+	// Mark the node as mid-write for the duration of the copy
+	atomic_store_explicit(slot_version, old + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	// Copy everything except the lock, which is still held by this thread
+	memcpy(slot, &node->node, offsetof(Node, lock));
+	atomic_store_explicit(slot_version, old + 2, memory_order_release);
+#ifdef NODE_CACHE
+	// Cache the new contents before anyone else can change them
+	node_cache_fill(node->addr, old + 2, &node->node);
+#endif
+	MEM_TRACE_RECORD(TRACE_WRITE_UNLOCK, node->addr);
+	lock_v(&slot->lock);
+}
+
+//! @brief See @ref mem_unlock
+static inline void slot_unlock(bptr_t address, Node *slot) {
+	MEM_TRACE_RECORD(TRACE_UNLOCK, address);
+	lock_v(&slot->lock);
+}
+
+//! @brief See @ref mem_prefetch
+static inline void slot_prefetch(Node const *slot) {
+	char const *line = (char const *) slot;
+	for (size_t i = 0; i < sizeof(Node); i += CACHE_LINE_SIZE) {
+		__builtin_prefetch(line + i);
+	}
+}
+
+//! @brief Blank a node and release its lock, as @ref mem_reset_all does to
+//!        every node
+//!
+//! Leaves the node cache alone, which the caller clears once for all nodes.
+static inline void slot_reset(Node *slot, _Atomic bver_t *slot_version) {
+	memset(slot, 0xFF, offsetof(Node, lock));
+	init_lock(&slot->lock);
+	atomic_store(slot_version, 0);
+}
+
+#endif
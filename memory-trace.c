@@ -0,0 +1,180 @@
+//! @file memory-trace.c
+//! @brief Recording of node accesses into a trace file
+//!
+//! Implements @ref memory-trace.h for the host memory backends built with
+//! `-DMEM_TRACE`. Each thread appends events to a buffer of its own, so that
+//! recording an access takes no lock, and buffers are written to the file
+//! under a mutex as they fill and when the trace is closed. Without
+//! `-DMEM_TRACE` this file compiles to nothing.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "memory-trace.h"
+#include "node.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#ifdef MEM_TRACE
+_Static_assert(sizeof(TraceEvent) == 16, "Trace events should stay compact");
+_Static_assert(MAX_LEVELS <= UINT8_MAX, "Levels must fit in a trace event");
+
+
+//! @brief Events recorded by one thread and not yet written out
+typedef struct TraceBuffer {
+	//! @brief Next buffer of the same trace
+	struct TraceBuffer *next;
+	uint16_t thread;
+	size_t n_events;
+	TraceEvent events[MEM_TRACE_BUFFER];
+} TraceBuffer;
+
+
+//! @brief Guards the file and the list of buffers
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+//! @brief The open trace, or NULL
+static FILE *trace_file;
+//! @brief Whether accesses are being recorded, checked on every access
+static atomic_bool tracing;
+//! @brief Bumped by each @ref mem_trace_open, so that threads can tell that
+//!        a buffer they had belongs to an earlier trace
+static _Atomic uint32_t generation;
+//! @brief Every thread's buffer for the open trace
+static TraceBuffer *buffers;
+//! @brief Number of threads which have recorded events in the open trace
+static uint32_t n_threads;
+//! @brief Clock reading when the trace was opened
+static uint64_t start_ns;
+//! @brief First failure to keep an event, reported when the trace is closed
+static ErrorCode trace_status;
+
+//! @brief The calling thread's buffer, if it belongs to the open trace
+static _Thread_local TraceBuffer *local_buffer;
+//! @brief Trace which the calling thread's buffer belongs to
+static _Thread_local uint32_t local_generation;
+
+
+//! @brief Current time in nanoseconds from a monotonic clock
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//! @brief Append a buffer's events to the file and empty it
+//!
+//! The caller must hold @ref trace_mutex.
+static void flush_locked(TraceBuffer *buffer) {
+	if (fwrite(buffer->events, sizeof(TraceEvent), buffer->n_events, trace_file)
+			!= buffer->n_events
+		&& trace_status == SUCCESS) {
+		trace_status = IO_ERROR;
+	}
+	buffer->n_events = 0;
+}
+
+//! @brief Give the calling thread a buffer for the open trace
+//! @return The buffer, or NULL if one could not be allocated
+static TraceBuffer *new_buffer() {
+	TraceBuffer *buffer = malloc(sizeof(TraceBuffer));
+
+	pthread_mutex_lock(&trace_mutex);
+	if (buffer) {
+		buffer->thread = n_threads++;
+		buffer->n_events = 0;
+		buffer->next = buffers;
+		buffers = buffer;
+	} else if (trace_status == SUCCESS) {
+		trace_status = OUT_OF_MEMORY;
+	}
+	pthread_mutex_unlock(&trace_mutex);
+	return buffer;
+}
+
+
+ErrorCode mem_trace_open(char const *path) {
+	TraceHeader header = {
+		.tree_order = TREE_ORDER,
+		.nodes_per_level = MAX_NODES_PER_LEVEL,
+		.levels = MAX_LEVELS,
+		.mem_size = MEM_SIZE,
+		.node_size = sizeof(Node),
+		.event_size = sizeof(TraceEvent),
+	};
+
+	if (trace_file) return INVALID_ARGUMENT;
+	trace_file = fopen(path, "wb");
+	if (!trace_file) return IO_ERROR;
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	if (fwrite(&header, sizeof(header), 1, trace_file) != 1) {
+		fclose(trace_file);
+		trace_file = NULL;
+		return IO_ERROR;
+	}
+	buffers = NULL;
+	n_threads = 0;
+	trace_status = SUCCESS;
+	start_ns = now_ns();
+	atomic_fetch_add(&generation, 1);
+	atomic_store(&tracing, true);
+	return SUCCESS;
+}
+
+
+void mem_trace_record(TraceOp op, bptr_t address) {
+	const uint32_t current =
+		atomic_load_explicit(&generation, memory_order_relaxed);
+	TraceBuffer *buffer;
+	bptr_t level;
+
+	if (!atomic_load_explicit(&tracing, memory_order_relaxed)) return;
+	// Buffers from earlier traces have been freed
+	if (local_generation != current) {
+		local_buffer = new_buffer();
+		local_generation = current;
+	}
+	buffer = local_buffer;
+	if (!buffer) return;
+
+	level = get_level(address);
+	buffer->events[buffer->n_events++] = (TraceEvent){
+		.time = now_ns() - start_ns,
+		.address = address,
+		.thread = buffer->thread,
+		.op = op,
+		.level = (level < MAX_LEVELS) ? level : MAX_LEVELS,
+	};
+	if (buffer->n_events == MEM_TRACE_BUFFER) {
+		pthread_mutex_lock(&trace_mutex);
+		flush_locked(buffer);
+		pthread_mutex_unlock(&trace_mutex);
+	}
+}
+
+
+ErrorCode mem_trace_close() {
+	ErrorCode status;
+
+	if (!trace_file) return INVALID_ARGUMENT;
+	atomic_store(&tracing, false);
+	pthread_mutex_lock(&trace_mutex);
+	while (buffers) {
+		TraceBuffer *next = buffers->next;
+		flush_locked(buffers);
+		free(buffers);
+		buffers = next;
+	}
+	if (fclose(trace_file) != 0 && trace_status == SUCCESS) {
+		trace_status = IO_ERROR;
+	}
+	trace_file = NULL;
+	status = trace_status;
+	pthread_mutex_unlock(&trace_mutex);
+	return status;
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef MEMORY_TRACE_H
+#define MEMORY_TRACE_H
+
+//! @file memory-trace.h
+//! @brief Recording of the node accesses made through @ref memory.h
+//!
+//! Built into memory-host.c and memory-mmap.c with `-DMEM_TRACE`, along with
+//! memory-trace.c. While a trace is open, every read, lock, write and unlock
+//! of a node is recorded as a @ref TraceEvent in a buffer belonging to the
+//! calling thread, which is appended to the trace file whenever it fills. The
+//! file is a @ref TraceHeader followed by the events, in runs from one thread
+//! at a time, each run in time order. bench/trace-replay.c analyses it.
+
+
+#include "types.h"
+
+
+//! @brief Identifies a trace file and the version of its format
+#define TRACE_MAGIC "BLNKTRC1"
+
+
+//! @brief Kinds of node access
+typedef enum {
+	//! @brief @ref mem_read or @ref mem_read_versioned
+	TRACE_READ,
+	//! @brief @ref mem_read_lock, timed from when the lock is held
+	TRACE_READ_LOCK,
+	//! @brief @ref mem_write_unlock, timed from before the lock is released
+	TRACE_WRITE_UNLOCK,
+	//! @brief @ref mem_unlock
+	TRACE_UNLOCK,
+	TRACE_OPS
+} TraceOp;
+
+//! @brief Start of a trace file
+typedef struct {
+	char magic[8];
+	//! @brief Geometry of the traced build
+	uint32_t tree_order;
+	uint32_t nodes_per_level;
+	uint32_t levels;
+	uint32_t mem_size;
+	uint32_t node_size;
+	//! @brief Size of each @ref TraceEvent that follows
+	uint32_t event_size;
+} TraceHeader;
+
+//! @brief One access to a node
+typedef struct {
+	//! @brief Nanoseconds since the trace was opened
+	uint64_t time;
+	bptr_t address;
+	//! @brief Thread which made the access, numbered from 0 in the order
+	//!        threads first access memory after the trace is opened
+	uint16_t thread;
+	//! @brief A @ref TraceOp
+	uint8_t op;
+	//! @brief Level of the node at the time, or MAX_LEVELS for memory not
+	//!        handed to any level
+	uint8_t level;
+} TraceEvent;
+
+
+#ifdef MEM_TRACE
+
+//! @brief Start recording accesses to a new trace file
+//!
+//! No other operation may be in progress.
+//! @param[in] path  File to write, replacing any existing one
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode mem_trace_open(char const *path);
+
+//! @brief Record an access by the calling thread, if a trace is open
+//! @param[in] op       Kind of access
+//! @param[in] address  Node accessed
+void mem_trace_record(TraceOp op, bptr_t address);
+
+//! @brief Write out every thread's remaining events and close the trace
+//!
+//! No other operation may be in progress, though threads which recorded
+//! events need not still exist.
+//! @return IO_ERROR if any events could not be written, OUT_OF_MEMORY if any
+//!         could not be buffered, INVALID_ARGUMENT if no trace was open, or
+//!         SUCCESS
+ErrorCode mem_trace_close();
+
+#define MEM_TRACE_RECORD(op, address) mem_trace_record(op, address)
+
+#else
+
+#define MEM_TRACE_RECORD(op, address) ((void) (address))
+
+#endif
+
+
+#endif
@@ -3,6 +3,7 @@
 
 
 #include "types.h"
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct Node Node;
@@ -10,8 +11,29 @@ typedef struct AddrNode AddrNode;
 
 
 //! @brief Read a node from memory without grabbing any locks
+//!
+//! The copy returned is always a consistent snapshot, never a mix of the
+//! node's contents before and after a concurrent write.
 Node mem_read(bptr_t address);
 
+//! @brief Read a node from memory without grabbing any locks, noting the
+//!        version of the snapshot returned
+//! @param[in]  address  Address of the node to read
+//! @param[out] version  Version of the node when it was read, to later be
+//!                      passed to @ref mem_validate
+Node mem_read_versioned(bptr_t address, bver_t *version);
+
+//! @brief Check that a node has not changed since it was read
+//!
+//! Lock-free readers use this to check that a node they read earlier, such
+//! as the parent through which they reached the current node, still says
+//! what it did at the time. Fails while the node is locked, since its
+//! holder may be part way through a change spanning several nodes.
+//! @param[in] address  Address of the node to check
+//! @param[in] version  Version from @ref mem_read_versioned
+//! @return True if the node is unchanged, false if the reader should restart
+bool mem_validate(bptr_t address, bver_t version);
+
 //! @brief Read a node from memory, locking it in memory
 Node mem_read_lock(bptr_t address);
 
@@ -25,6 +47,12 @@ void mem_write_unlock(AddrNode *node);
 //! modification operation completes.
 void mem_unlock(bptr_t address);
 
+//! @brief Hint that a node will be read soon
+//!
+//! Lets a backend start fetching the node so that a later read of it does
+//! not stall. Has no observable effect and may be a no-op.
+void mem_prefetch(bptr_t address);
+
 //! @brief Reset memory to a slate of blank nodes
 //!
 //! All data is 1s except for locks
@@ -0,0 +1,178 @@
+#include "node-cache.h"
+#include "node.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+
+#ifdef NODE_CACHE
+#ifndef ATOMIC_LOCKS
+#error "node-cache.c requires ATOMIC_LOCKS to be defined for all sources"
+#endif
+
+
+//! @brief A cached copy of one node
+typedef struct {
+	//! @brief Seqlock counter, odd while the entry is being filled and 0 if
+	//!        it never has been
+	_Atomic uint32_t seq;
+	//! @brief Address of the node held
+	_Atomic bptr_t addr;
+	//! @brief Version of the node the copy was taken at
+	_Atomic bver_t version;
+	//! @brief Whether the node is on a pinned level
+	atomic_bool pinned;
+	//! @brief Set when the entry is read, and cleared as the clock hand
+	//!        passes, which only evicts entries not read since it last did
+	atomic_bool referenced;
+	//! @brief The node, less its synchronization state
+	unsigned char data[offsetof(Node, lock)];
+} Entry;
+
+//! @brief Entries which a node may be cached in
+typedef struct {
+	Entry ways[NODE_CACHE_WAYS];
+	//! @brief Position of the clock hand, modulo NODE_CACHE_WAYS
+	_Atomic uint32_t hand;
+} Set;
+
+
+//! @brief The whole cache, zeroed before first use like @ref node_cache_clear
+static Set sets[NODE_CACHE_SETS];
+
+
+//! @brief Find the set a node is cached in
+//!
+//! The address is hashed first, since the slots in use on each level of the
+//! memory grid start at the same offsets, and would otherwise pile the
+//! pinned upper levels into the first few sets.
+static inline Set *set_of(bptr_t address) {
+	const uint32_t hash = (uint32_t) address * 2654435761u;
+	return &sets[((uint64_t) hash * NODE_CACHE_SETS) >> 32];
+}
+
+
+//! @brief Check whether nodes at an address are kept in the cache for good
+static inline bool is_pinned(bptr_t address) {
+	const bptr_t level = get_level(address);
+	// Unused memory has no level below MAX_LEVELS
+	return level >= NODE_CACHE_PIN_LEVEL && level < MAX_LEVELS;
+}
+
+
+bool node_cache_read(bptr_t address, bver_t version, Node *node) {
+	Set *set = set_of(address);
+
+	for (unsigned w = 0; w < NODE_CACHE_WAYS; ++w) {
+		Entry *e = &set->ways[w];
+		const uint32_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+		if (seq == 0 || (seq & 1)
+			|| atomic_load_explicit(&e->addr, memory_order_relaxed) != address
+			|| atomic_load_explicit(&e->version, memory_order_relaxed)
+				!= version) {
+			continue;
+		}
+		memcpy(node, e->data, sizeof(e->data));
+		// Ignore the copy if the entry was refilled while it was being made
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&e->seq, memory_order_relaxed) != seq) continue;
+		// Hot entries such as the root are read by every thread, so avoid
+		// writing to them each time
+		if (!atomic_load_explicit(&e->referenced, memory_order_relaxed)) {
+			atomic_store_explicit(&e->referenced, true, memory_order_relaxed);
+		}
+		STATS_INC(cache_hits);
+		return true;
+	}
+	STATS_INC(cache_misses);
+	return false;
+}
+
+
+//! @brief Pick an entry to evict from a set with a sweep of the clock hand
+//! @return The entry, or NULL if all of the set's entries are pinned
+static Entry *choose_victim(Set *set) {
+	// The first pass may only clear reference bits, the second finds one
+	for (unsigned step = 0; step < 2*NODE_CACHE_WAYS; ++step) {
+		const uint32_t w = atomic_fetch_add_explicit(
+			&set->hand, 1, memory_order_relaxed) % NODE_CACHE_WAYS;
+		Entry *e = &set->ways[w];
+		if (atomic_load_explicit(&e->seq, memory_order_relaxed) == 0) return e;
+		if (atomic_load_explicit(&e->pinned, memory_order_relaxed)) continue;
+		if (atomic_exchange_explicit(
+				&e->referenced, false, memory_order_relaxed)) {
+			continue;
+		}
+		return e;
+	}
+	return NULL;
+}
+
+
+void node_cache_fill(bptr_t address, bver_t version, Node const *node) {
+	Set *set = set_of(address);
+	const bool valid = is_valid(node);
+	Entry *e = NULL;
+	uint32_t seq;
+
+	// Refresh the node's own entry if it has one, so that older copies of
+	// a node don't crowd out other nodes
+	for (unsigned w = 0; w < NODE_CACHE_WAYS; ++w) {
+		if (atomic_load_explicit(&set->ways[w].addr, memory_order_relaxed)
+				== address
+			&& atomic_load_explicit(&set->ways[w].seq, memory_order_relaxed)
+				!= 0) {
+			e = &set->ways[w];
+			break;
+		}
+	}
+	// A reader may only get round to filling in what it read after a writer
+	// has cached a newer version
+	if (e != NULL && (int32_t) (atomic_load_explicit(
+			&e->version, memory_order_relaxed) - version) > 0) {
+		return;
+	}
+	// Free slots are only read to claim them, or to survey memory, neither of
+	// which is worth evicting anything for
+	if (e == NULL && !valid) return;
+	if (e == NULL) e = choose_victim(set);
+	if (e == NULL) return;
+
+	seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+	if ((seq & 1) || !atomic_compare_exchange_strong(&e->seq, &seq, seq + 1)) {
+		return;
+	}
+	atomic_store_explicit(&e->addr, address, memory_order_relaxed);
+	atomic_store_explicit(&e->version, version, memory_order_relaxed);
+	atomic_store_explicit(&e->pinned, valid && is_pinned(address),
+		memory_order_relaxed);
+	atomic_store_explicit(&e->referenced, false, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(e->data, node, sizeof(e->data));
+	atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+
+void node_cache_clear() {
+	memset(sets, 0, sizeof(sets));
+}
+
+
+void node_cache_stats(NodeCacheStats *stats) {
+	stats->capacity = NODE_CACHE_SETS * NODE_CACHE_WAYS;
+	stats->used = 0;
+	stats->pinned = 0;
+	for (uint32_t s = 0; s < NODE_CACHE_SETS; ++s) {
+		for (unsigned w = 0; w < NODE_CACHE_WAYS; ++w) {
+			Entry const *e = &sets[s].ways[w];
+			if (atomic_load_explicit(&e->seq, memory_order_relaxed) == 0) {
+				continue;
+			}
+			++stats->used;
+			if (atomic_load_explicit(&e->pinned, memory_order_relaxed)) {
+				++stats->pinned;
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef NODE_CACHE_H
+#define NODE_CACHE_H
+
+//! @file node-cache.h
+//! @brief Cache of node snapshots kept by host memory backends
+//!
+//! Built into memory-host.c and memory-mmap.c with `-DNODE_CACHE`. Each entry
+//! holds a copy of a node as of one version of its seqlock, so an entry only
+//! serves reads while the node is still at that version, and any write makes
+//! it stale without the cache having to be told. Locks and versions stay in
+//! backing memory, which is always written through, so the cache never holds
+//! anything that backing memory does not. Entries are placed in sets by a
+//! hash of the address and replaced by a clock sweep within the set, except
+//! that nodes in use on NODE_CACHE_PIN_LEVEL and above are never evicted.
+
+
+#include "types.h"
+#include <stdbool.h>
+typedef struct Node Node;
+
+
+//! @brief Occupancy of the node cache
+typedef struct {
+	//! @brief Nodes the cache can hold
+	uint32_t capacity;
+	//! @brief Entries holding a node, current or not
+	uint32_t used;
+	//! @brief Entries holding a node on a pinned level
+	uint32_t pinned;
+} NodeCacheStats;
+
+
+//! @brief Copy out a node if the cache holds it as of a version
+//! @param[in]  address  Address of the node to look up
+//! @param[in]  version  Version of the node in backing memory, which must be
+//!                      even
+//! @param[out] node     The node as of that version, on a hit
+//! @return Whether the cache held the node as of the version
+bool node_cache_read(bptr_t address, bver_t version, Node *node);
+
+//! @brief Store a node as of a version, taking the place of an older copy
+//!
+//! Gives up rather than wait if another thread is filling the same entry, or
+//! if every entry in the set is pinned. Free nodes only take the place of an
+//! older copy of themselves.
+//! @param[in] address  Address of the node
+//! @param[in] version  Version of the node in backing memory which the
+//!                     contents match
+//! @param[in] node     The node's contents
+void node_cache_fill(bptr_t address, bver_t version, Node const *node);
+
+//! @brief Drop every entry
+//!
+//! Needed whenever versions in backing memory start over, since old entries
+//! could otherwise match them. No other operation may be in progress.
+void node_cache_clear();
+
+//! @brief Survey the cache's entries
+//!
+//! Reads every entry, so this is meant for sizing the cache rather than the
+//! hot path. Hits and misses are counted in @ref OpStats.
+//! @param[out] stats  Occupancy of the cache
+void node_cache_stats(NodeCacheStats *stats);
+
+
+#endif
@@ -1,29 +1,43 @@
 #include "node.h"
+#include "key-search.h"
 
 
 bstatusval_t find_next(Node const *n, bkey_t key) {
 	bstatusval_t result = {SUCCESS, {INVALID}};
-	for (li_t i = 0; i < TREE_ORDER; ++i) {
+	// The node split since we followed a pointer to it,
+	// so the key is now in its right sibling
+	if (past_high_key(n, key)) {
+		result.value.ptr = n->next;
+		return result;
+	}
+	// INVALID compares greater than or equal to every key, so this stops at
+	// either the first key greater than or equal to what we're looking for
+	// or the first uninitialized key
+	const li_t i = first_geq(n, key);
+	if (i < TREE_ORDER) {
 		// We overshot the node we were looking for
 		// and got an uninitialized key
 		if (n->keys[i] == INVALID) {
-			// Empty node, error
+			// Empty node, error, unless it is a root collapsed by erase
+			// which still leads to its only child
 			if (i == 0) {
-				result.status = NOT_FOUND;
-				return result;
+				if (n->values[0].ptr == INVALID) {
+					result.status = NOT_FOUND;
+				} else {
+					result.value = n->values[0];
+				}
 			}
 			// Save the last node we looked at
 			else {
 				result.value = n->values[i-1];
-				return result;
 			}
 		}
 		// If this key is the first key greater than what we're looking for
 		// then continue down this subtree
-		else if (key <= n->keys[i]) {
+		else {
 			result.value = n->values[i];
-			return result;
 		}
+		return result;
 	}
 	// Wasn't in this node, check sibling
 	if (n->next == INVALID) {
@@ -39,11 +53,10 @@ bstatusval_t find_next(Node const *n, bkey_t key) {
 
 bstatusval_t find_value(Node const *n, bkey_t key) {
 	bstatusval_t result = {SUCCESS, {INVALID}};
-	for (li_t i = 0; i < TREE_ORDER; ++i) {
-		if (n->keys[i] == key) {
-			result.value = n->values[i];
-			return result;
-		}
+	const li_t i = first_eq(n, key);
+	if (i < TREE_ORDER) {
+		result.value = n->values[i];
+		return result;
 	}
 	result.status = NOT_FOUND;
 	return result;
@@ -58,9 +71,32 @@ bool is_full(Node const *n) {
 	return n->keys[TREE_ORDER-1] != INVALID;
 }
 
+li_t num_keys(Node const *n) {
+	li_t i = 0;
+	while (i < TREE_ORDER && n->keys[i] != INVALID) ++i;
+	return i;
+}
+
+li_t find_child(Node const *n, bptr_t child) {
+	for (li_t i = 0; i < TREE_ORDER; ++i) {
+		if (n->keys[i] == INVALID) break;
+		if (n->values[i].ptr == child) return i;
+	}
+	return TREE_ORDER;
+}
+
 void clear(Node *n) {
 	for (li_t i = 0; i < TREE_ORDER; ++i) {
 		n->keys[i] = INVALID;
 		n->values[i].data = INVALID;
 	}
+	n->low_key = INVALID;
+	n->high_key = INVALID;
+}
+
+void retire(Node *n) {
+	clear(n);
+	n->next = INVALID;
+	// Every valid key is at or below this bound
+	n->low_key = INVALID - 1;
 }
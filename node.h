@@ -6,6 +6,30 @@
 #include "types.h"
 
 
+//! Nodes are packed by default, which is the layout the FPGA flow expects.
+//! CPU builds may pass `-DALIGNED_NODES` to instead start every node on a
+//! cache line, with the lock and seqlock version on a line of their own so
+//! that readers scanning keys and writers taking locks do not contend for the
+//! same lines.
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE (64)
+#endif
+#if defined(ELASTIC_LEVELS) && defined(__SYNTHESIS__)
+	#error "ELASTIC_LEVELS is for host builds only"
+#endif
+#ifdef ELASTIC_LEVELS
+	#include "alloc.h"
+#endif
+#ifdef ALIGNED_NODES
+	#if defined(__SYNTHESIS__) || !defined(ATOMIC_LOCKS)
+		#error "ALIGNED_NODES requires a host build with ATOMIC_LOCKS"
+	#endif
+	#define NODE_LAYOUT __attribute__((aligned(CACHE_LINE_SIZE)))
+#else
+	#define NODE_LAYOUT __attribute__((packed))
+#endif
+
+
 //! @brief A generic node within the tree
 //!
 //! Can be a leaf node or an inner node
@@ -29,18 +53,69 @@ struct Node {
 	//!
 	//! These may be leaf data or pointers within the tree.
 	bptr_t next;
+	//! @brief Exclusive lower bound on the keys held in or beneath this node
+	//!
+	//! This is the high key of the node to the left. Keys only ever move
+	//! left when entries are rebalanced after an erase, so a writer which
+	//! locks a node and finds its key at or below this bound reached the node
+	//! through a stale pointer and starts over from the root. INVALID for the
+	//! leftmost node of each level.
+	bkey_t low_key;
+	//! @brief Upper bound on the keys held in or beneath this node
+	//!
+	//! Any larger key belongs to a node further along the `next` chain. A
+	//! traversal that finds a key past this bound, because the node split
+	//! after its parent was read, moves right instead of descending.
+	//! INVALID for the rightmost node of each level.
+	bkey_t high_key;
+#ifdef ELASTIC_LEVELS
+	//! @brief Level of the tree the node was allocated to, the leaves being 0
+	//!
+	//! Lets the allocator work out which chunks of memory belong to which
+	//! level after memory is reloaded. 0xFF in slots never used.
+	uint8_t level;
+#endif
 	//! @brief Used to restrict concurrent modifications to this node
+	//!
+	//! Everything from here on is synchronization state, which is not copied
+	//! when nodes are read or written.
+#ifdef ALIGNED_NODES
+	lock_t lock __attribute__((aligned(CACHE_LINE_SIZE)));
+	//! @brief Seqlock counter, odd while the node is being written
+	atomic_ver_t version;
+#else
 	lock_t lock;
-} __attribute__((packed));
+#endif
+} NODE_LAYOUT;
 typedef struct Node Node;
 
+//! @brief Check if a key lies beyond a node's range, such that it should be
+//!        looked for in the node's right sibling instead
+//! @param[in] n    The node to check
+//! @param[in] key  The key being looked for
+inline static bool past_high_key(Node const *n, bkey_t key) {
+	return key > n->high_key && n->next != INVALID;
+}
+
+//! @brief Check if a key lies before a node's range, such that the node was
+//!        reached through a stale pointer
+//! @param[in] n    The node to check
+//! @param[in] key  The key being looked for
+inline static bool before_low_key(Node const *n, bkey_t key) {
+	return n->low_key != INVALID && key <= n->low_key;
+}
+
 //! @brief Traverse the tree structure in search of the given key
 //! @param[in] key The key to search for
 //! @return A result containing a status code for success/failure of the
 //!         operation along with the address of the next node to check on
-//!         success. If this is a leaf node, its data will be returned.
+//!         success. If the key is past this node's high key, this is the
+//!         node's right sibling rather than one of its children.
 bstatusval_t find_next(Node const *n, bkey_t key);
 //! @brief Find the value corresponding to a given key
+//!
+//! Only checks this node. Callers should first move right along the leaf
+//! level while @ref past_high_key holds.
 bstatusval_t find_value(Node const *n, bkey_t key);
 //! @brief "Is empty", returns true for unallocated memory
 bool is_valid(Node const *n);
@@ -48,17 +123,68 @@ bool is_valid(Node const *n);
 //! @param[in] node  The node to check
 //! @return True if all keys are in use, false otherwise
 bool is_full(Node const *n);
+//! @brief Count the keys in use in a node
+//! @param[in] node  The node to check
+//! @return Number of valid keys, equivalently the number of children or data
+//!         values
+li_t num_keys(Node const *n);
+//! @brief Find the index of a child within an inner node
+//! @param[in] node   The node to check
+//! @param[in] child  Address of the child to look for
+//! @return Index of the child, or TREE_ORDER if it is not present
+li_t find_child(Node const *n, bptr_t child);
 //! @brief Empty this node's contents and restore its default state
 void clear(Node *n);
+//! @brief Record which level of the tree a node is being allocated to
+//!
+//! Only stored in builds with `-DELASTIC_LEVELS`, where addresses alone do
+//! not say
+inline static void set_level(Node *n, uint_fast8_t level) {
+#ifdef ELASTIC_LEVELS
+	n->level = level;
+#else
+	(void) n;
+	(void) level;
+#endif
+}
+//! @brief Empty a node which is being removed from the tree
+//!
+//! Anything still holding the node's address will find that it covers no
+//! keys, until the slot is reallocated.
+void retire(Node *n);
 
 
 //! @brief A node that knows the address where it resides in the tree
 struct AddrNode {
 	Node node;
 	bptr_t addr;
-} __attribute__((packed));
+} NODE_LAYOUT;
 typedef struct AddrNode AddrNode;
 
+#ifdef ELASTIC_LEVELS
+//! @brief Check which level of the tree a node address resides on
+//!
+//! Looks up the level its chunk of memory was handed to
+//! @param[in] node_ptr  The node address to check
+//! @return The level, or MAX_LEVELS or above if the chunk is unused
+inline static bptr_t get_level(bptr_t node_ptr) {
+	return chunk_level(node_ptr / LEVEL_CHUNK_SIZE);
+}
+
+//! @brief Check which region of memory a node address resides in
+//!
+//! Each region is a run of whole chunks
+//! @param[in] node_ptr  The node address to check
+inline static bptr_t get_region(bptr_t node_ptr) {
+	return node_ptr / (MEM_SIZE / MEM_REGIONS);
+}
+
+//! @brief Check if a node at the given address is a leaf node or an inner node
+//! @param[in] addr  Address of the node within the tree to check
+inline static bool is_leaf(bptr_t addr) {
+	return get_level(addr) == 0;
+}
+#else
 //! @brief Check if a node at the given address is a leaf node or an inner node
 //! @param[in] addr  Address of the node within the tree to check
 inline static bool is_leaf(bptr_t addr) {
@@ -73,5 +199,15 @@ inline static bptr_t get_level(bptr_t node_ptr) {
 	return (node_ptr / MAX_NODES_PER_LEVEL);
 }
 
+//! @brief Check which region of memory a node address resides in
+//!
+//! Each region takes an equal share of every level
+//! @param[in] node_ptr  The node address to check
+inline static bptr_t get_region(bptr_t node_ptr) {
+	return (node_ptr % MAX_NODES_PER_LEVEL)
+		/ (MAX_NODES_PER_LEVEL / MEM_REGIONS);
+}
+#endif
+
 
 #endif
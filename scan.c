@@ -0,0 +1,138 @@
+#include "scan.h"
+#include "memory.h"
+#include "node.h"
+#include "tree-helpers.h"
+#include <string.h>
+
+
+//! @brief Destination for @ref scan_buffer
+typedef struct {
+	bkey_t *keys;
+	bval_t *values;
+	size_t n;
+} ScanBuffer;
+
+//! @brief Callback which appends entries to a @ref ScanBuffer
+static bool append_to_buffer(bkey_t key, bval_t value, void *ctx) {
+	ScanBuffer *buf = (ScanBuffer *) ctx;
+	buf->keys[buf->n] = key;
+	buf->values[buf->n] = value;
+	buf->n++;
+	return true;
+}
+
+
+//! @brief Find the leaf at which to (re)start a scan
+//!
+//! The cursor's leaf hint is only trusted if that leaf still starts at or
+//! before the cursor's lower bound. Splits only move keys rightward, so the
+//! remainder of the range is then reachable through `next` links.
+//! @param[in]  root    The root of the tree to scan
+//! @param[in]  cursor  The scan position to start from
+//! @param[out] leaf    Address of the first leaf to visit
+//! @return An error code representing the success or type of failure of the
+//!         operation
+static ErrorCode find_start(
+	bptr_t root, ScanCursor const *cursor, bptr_t *leaf
+) {
+	bptr_t lineage[MAX_LEVELS];
+	ErrorCode status;
+
+	if (cursor->leaf != INVALID) {
+		Node node = mem_read(cursor->leaf);
+		if (is_valid(&node) && node.keys[0] <= cursor->lo) {
+			*leaf = cursor->leaf;
+			return SUCCESS;
+		}
+	}
+	memset(lineage, INVALID, MAX_LEVELS*sizeof(bptr_t));
+	status = trace_lineage(root, cursor->lo, lineage);
+	if (status != SUCCESS) return status;
+	*leaf = lineage[get_leaf_idx(lineage)];
+	return SUCCESS;
+}
+
+
+void scan_init(ScanCursor *cursor, bkey_t lo, bkey_t hi) {
+	cursor->leaf = INVALID;
+	cursor->lo = lo;
+	cursor->hi = hi;
+	cursor->done = (lo >= hi);
+}
+
+
+ErrorCode scan(
+	bptr_t root, ScanCursor *cursor, size_t limit,
+	scan_fn_t fn, void *ctx, size_t *count
+) {
+	ErrorCode status;
+	bptr_t addr, prev = INVALID;
+	bver_t version, prev_version;
+	Node leaf;
+	size_t n = 0;
+
+	if (count != NULL) *count = 0;
+	if (cursor->done) return SUCCESS;
+	status = find_start(root, cursor, &addr);
+	if (status != SUCCESS) return status;
+
+	// Stream entries leaf by leaf without returning to the root
+	while (addr != INVALID) {
+		leaf = mem_read_versioned(addr, &version);
+		// Start over from the root if the leaf we came from changed, since
+		// its next link may no longer lead here, or if this leaf has been
+		// emptied and reclaimed since we found it
+		if ((prev != INVALID && !mem_validate(prev, prev_version))
+			|| (!is_valid(&leaf) && addr != root)) {
+			STATS_INC(restarts);
+			cursor->leaf = INVALID;
+			status = find_start(root, cursor, &addr);
+			if (status != SUCCESS) return status;
+			prev = INVALID;
+			continue;
+		}
+		cursor->leaf = addr;
+		for (li_t i = 0; i < TREE_ORDER; ++i) {
+			const bkey_t key = leaf.keys[i];
+			if (key == INVALID) break;
+			if (key < cursor->lo) continue;
+			if (key >= cursor->hi) {
+				cursor->done = true;
+				break;
+			}
+			// Advance the cursor before handing out the entry so that it
+			// is consistent if the caller stops here
+			cursor->lo = key + 1;
+			n++;
+			if (!fn(key, leaf.values[i], ctx)
+				|| (limit != 0 && n == limit)) {
+				cursor->done = (cursor->lo >= cursor->hi);
+				if (count != NULL) *count = n;
+				return SUCCESS;
+			}
+		}
+		if (cursor->done) break;
+		prev = addr;
+		prev_version = version;
+		addr = leaf.next;
+	}
+
+	cursor->done = true;
+	if (count != NULL) *count = n;
+	return SUCCESS;
+}
+
+
+ErrorCode scan_buffer(
+	bptr_t root, ScanCursor *cursor,
+	bkey_t *keys, bval_t *values, size_t capacity, size_t *count
+) {
+	ScanBuffer buf = {keys, values, 0};
+	ErrorCode status;
+
+	*count = 0;
+	if (capacity == 0) return INVALID_ARGUMENT;
+	status = scan(root, cursor, capacity, append_to_buffer, &buf, NULL);
+	*count = buf.n;
+	return status;
+}
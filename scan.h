@@ -0,0 +1,68 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+
+//! @brief Position within a range scan over `[lo, hi)`
+//!
+//! Holds no locks and no node contents, so a scan may be paused between
+//! pages for as long as the caller likes and resumed later, even while other
+//! operations modify the tree.
+typedef struct {
+	//! @brief Leaf at which to resume, used as a hint to avoid retracing the
+	//!        tree from the root. INVALID if no hint is available.
+	bptr_t leaf;
+	//! @brief Inclusive lower bound of the keys which have yet to be visited
+	bkey_t lo;
+	//! @brief Exclusive upper bound of the scan
+	bkey_t hi;
+	//! @brief Set once every key in the range has been visited
+	bool done;
+} ScanCursor;
+
+//! @brief Function called for each entry visited by a scan
+//! @param[in] key    Key of the current entry
+//! @param[in] value  Value of the current entry
+//! @param[in] ctx    Caller-supplied context pointer
+//! @return True to continue the scan, false to stop after this entry
+typedef bool (*scan_fn_t)(bkey_t key, bval_t value, void *ctx);
+
+//! @brief Prepare a cursor for a scan over keys in `[lo, hi)`
+//! @param[out] cursor  The cursor to initialize
+//! @param[in]  lo      Inclusive lower bound of the range
+//! @param[in]  hi      Exclusive upper bound of the range, INVALID to scan
+//!                     to the end of the tree
+void scan_init(ScanCursor *cursor, bkey_t lo, bkey_t hi);
+
+//! @brief Visit entries in key order, passing each to a callback
+//! @param[in]    root    The root of the tree to scan
+//! @param[inout] cursor  Scan position, advanced past every visited entry
+//! @param[in]    limit   Maximum number of entries to visit, 0 for no limit
+//! @param[in]    fn      Function to call on each entry
+//! @param[in]    ctx     Context pointer passed through to `fn`
+//! @param[out]   count   Number of entries visited, may be NULL
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode scan(
+	bptr_t root, ScanCursor *cursor, size_t limit,
+	scan_fn_t fn, void *ctx, size_t *count
+);
+
+//! @brief Copy entries in key order into caller-supplied buffers
+//! @param[in]    root      The root of the tree to scan
+//! @param[inout] cursor    Scan position, advanced past every copied entry
+//! @param[out]   keys      Buffer for the keys of visited entries
+//! @param[out]   values    Buffer for the values of visited entries
+//! @param[in]    capacity  Number of entries both buffers can hold
+//! @param[out]   count     Number of entries copied
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode scan_buffer(
+	bptr_t root, ScanCursor *cursor,
+	bkey_t *keys, bval_t *values, size_t capacity, size_t *count
+);
+
+#endif
@@ -6,17 +6,92 @@
 bstatusval_t search(bptr_t root, bkey_t key) {
 	bstatusval_t result;
 	AddrNode n;
-	n.addr = root;
-
-	// Iterate until we hit a leaf
-	while (!is_leaf(n.addr)) {
-		n.node = mem_read(n.addr);
-		result = find_next(&n.node, key);
-		if (result.status != SUCCESS) return result;
-		n.addr = result.value.ptr;
-	}
+	bptr_t parent;
+	bver_t version, parent_version;
+	bool valid;
+
+	do {
+		n.addr = root;
+		parent = INVALID;
+		valid = true;
+		// Iterate until we hit the key's leaf, starting over if the node we
+		// came from changed while we were reading its child, and moving right
+		// past any node that split since it was reached
+		while (valid) {
+			n.node = mem_read_versioned(n.addr, &version);
+			valid = parent == INVALID || mem_validate(parent, parent_version);
+			if (!valid) {
+				STATS_INC(restarts);
+				break;
+			}
+			if (is_leaf(n.addr) && !past_high_key(&n.node, key)) break;
+			result = find_next(&n.node, key);
+			if (result.status != SUCCESS) return result;
+			parent = n.addr;
+			parent_version = version;
+			n.addr = result.value.ptr;
+		}
+	} while (!valid);
 
 	// Search within the leaf node of the lineage for the key
-	n.node = mem_read(n.addr);
 	return find_value(&n.node, key);
 }
+
+
+void search_batch(
+	bptr_t root, bkey_t const *keys, size_t n, bstatusval_t *results
+) {
+	bptr_t addr[SEARCH_BATCH_WIDTH];
+	bptr_t parent[SEARCH_BATCH_WIDTH];
+	bver_t parent_version[SEARCH_BATCH_WIDTH];
+	bstatusval_t result;
+	bver_t version;
+	Node node;
+	bool pending;
+
+	for (size_t base = 0; base < n; base += SEARCH_BATCH_WIDTH) {
+		const size_t width = (n - base < SEARCH_BATCH_WIDTH)
+			? n - base : SEARCH_BATCH_WIDTH;
+		for (size_t i = 0; i < width; ++i) {
+			addr[i] = root;
+			parent[i] = INVALID;
+		}
+		mem_prefetch(root);
+
+		// Descend one level per pass until every search reaches its key's
+		// leaf, restarting any search whose parent changed underneath it
+		// Finished searches are marked with an INVALID address
+		do {
+			pending = false;
+			for (size_t i = 0; i < width; ++i) {
+				if (addr[i] == INVALID) continue;
+				node = mem_read_versioned(addr[i], &version);
+				if (parent[i] != INVALID
+					&& !mem_validate(parent[i], parent_version[i])) {
+					STATS_INC(restarts);
+					addr[i] = root;
+					parent[i] = INVALID;
+					pending = true;
+					continue;
+				}
+				if (is_leaf(addr[i]) && !past_high_key(&node, keys[base+i])) {
+					// Search within the leaf node of the lineage for the key
+					results[base+i] = find_value(&node, keys[base+i]);
+					addr[i] = INVALID;
+					continue;
+				}
+				result = find_next(&node, keys[base+i]);
+				if (result.status != SUCCESS) {
+					results[base+i] = result;
+					addr[i] = INVALID;
+					continue;
+				}
+				parent[i] = addr[i];
+				parent_version[i] = version;
+				addr[i] = result.value.ptr;
+				mem_prefetch(addr[i]);
+				pending = true;
+			}
+		} while (pending);
+	}
+}
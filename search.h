@@ -2,6 +2,7 @@
 #define SEARCH_H
 
 #include "types.h"
+#include <stddef.h>
 
 //! @brief Search a tree for a key
 //! @param[in]  root   The root of the tree to search
@@ -9,4 +10,24 @@
 //! @return Struct containing requested data on success and an error code
 bstatusval_t search(bptr_t root, bkey_t key);
 
+//! @brief Number of searches kept in flight at once by @ref search_batch
+#ifndef SEARCH_BATCH_WIDTH
+#define SEARCH_BATCH_WIDTH (32)
+#endif
+
+//! @brief Search a tree for many keys at once
+//!
+//! Keys are processed in groups of @ref SEARCH_BATCH_WIDTH which descend the
+//! tree one level at a time in lockstep. The child of every search in the
+//! group is prefetched before any of them is read, so that the latency of
+//! fetching each level is overlapped across the whole group.
+//! @param[in]  root     The root of the tree to search
+//! @param[in]  keys     The keys to search for
+//! @param[in]  n        Number of keys to search for
+//! @param[out] results  Result of searching for each key, as returned by
+//!                      @ref search
+void search_batch(
+	bptr_t root, bkey_t const *keys, size_t n, bstatusval_t *results
+);
+
 #endif
@@ -1,4 +1,6 @@
 #include "split.h"
+#include "alloc.h"
+#include "insert-helpers.h"
 #include "memory.h"
 #include "node.h"
 #include <string.h>
@@ -9,6 +11,10 @@
 //! @return ceil(x/2)
 #define DIV2CEIL(x) (((x) & 1) ? (((x)/2) + 1) : ((x)/2))
 
+#if APPEND_SPLIT_KEEP < DIV2CEIL(TREE_ORDER) || APPEND_SPLIT_KEEP >= TREE_ORDER
+#error "APPEND_SPLIT_KEEP must keep at least half the entries but not all"
+#endif
+
 
 //! @brief Clear a node's keys
 //! @param[in] node  The node whose keys should be cleared
@@ -16,55 +22,80 @@ inline static void init_node(Node *node) {
 	memset(node->keys, INVALID, TREE_ORDER * sizeof(bkey_t));
 }
 
+ErrorCode lock_empty_slot(
+	uint_fast8_t level, bptr_t region,
+	AddrNode *slot, bptr_t const *held, size_t n_held
+) {
+	size_t skipped = 0;
+	bool is_held;
+
+	for (;;) {
+		slot->addr = alloc_slot(level, region);
+		if (slot->addr == INVALID) return OUT_OF_MEMORY;
+		// Locked slots which are empty, or not yet written, look free once
+		// the allocator rebuilds its view of memory
+		is_held = false;
+		for (size_t i = 0; i < n_held; ++i) {
+			if (held[i] == slot->addr) is_held = true;
+		}
+		if (is_held) {
+			// Nothing left on the level but what we already hold
+			if (++skipped > n_held) return OUT_OF_MEMORY;
+			continue;
+		}
+		// The allocator may not know a slot was taken, and it is now marked.
+		// Check before locking so as not to wait on a node held elsewhere.
+		slot->node = mem_read(slot->addr);
+		if (is_valid(&slot->node)) continue;
+		slot->node = mem_read_lock(slot->addr);
+		// Found an empty slot
+		if (!is_valid(&slot->node)) break;
+		mem_unlock(slot->addr);
+	}
+	set_level(&slot->node, level);
+	return SUCCESS;
+}
+
 //! @brief Allocate a new sibling node in an empty slot in main mameory
 //!
 //! Acquires a lock on the sibling node
 static ErrorCode alloc_sibling(
-	//! [in] Root of the tree the nodes reside in
-	bptr_t const *root,
 	//! [in] The node to split
 	AddrNode *leaf,
+	//! [in] Number of entries the split node keeps
+	li_t keep,
 	//! [out] The contents of the split node's new sibling
 	AddrNode *sibling
 ) {
-	const uint_fast8_t level = get_level(leaf->addr);
-
 	// Find an empty spot for the new leaf
-	for (sibling->addr = level * MAX_NODES_PER_LEVEL;
-		sibling->addr < (level+1) * MAX_NODES_PER_LEVEL;
-		++sibling->addr) {
-		// Found an empty slot
-		if (leaf->addr != sibling->addr
-			&& mem_read(sibling->addr).keys[0] == INVALID) {
-			break;
-		}
-	}
-	sibling->node = mem_read_lock(sibling->addr);
-	// If we didn't break, we didn't find an empty slot
-	if (sibling->addr == (level+1) * MAX_NODES_PER_LEVEL) {
-		mem_unlock(sibling->addr);
-		return OUT_OF_MEMORY;
-	}
+	ErrorCode status = lock_empty_slot(
+		get_level(leaf->addr), get_region(leaf->addr), sibling, NULL, 0);
+	if (status != SUCCESS) return status;
 	// Adjust next node pointers
 	sibling->node.next = leaf->node.next;
 	leaf->node.next = sibling->addr;
-	// Move half of old node's contents to new node
-	for (li_t i = 0; i < TREE_ORDER/2; ++i) {
-		sibling->node.keys[i] = leaf->node.keys[i + (TREE_ORDER/2)];
-		sibling->node.values[i] = leaf->node.values[i + (TREE_ORDER/2)];
-		leaf->node.keys[i + (TREE_ORDER/2)] = INVALID;
+	// Move the old node's contents past the split point to the new node
+	for (li_t i = 0; i < TREE_ORDER - keep; ++i) {
+		sibling->node.keys[i] = leaf->node.keys[i + keep];
+		sibling->node.values[i] = leaf->node.values[i + keep];
+		leaf->node.keys[i + keep] = INVALID;
 	}
+	// The sibling inherits the old node's range above the split point
+	sibling->node.high_key = leaf->node.high_key;
+	leaf->node.high_key = leaf->node.keys[keep-1];
+	sibling->node.low_key = leaf->node.high_key;
 
 	return SUCCESS;
 }
 
 
 //! @brief Assign an allocated sibling pair at the root leve of the tree
+//!
+//! The new root is locked but not published; the caller updates the root
+//! pointer once it has been written.
 //! @return An error code representing the success or type of failure of the
 //!         operation
 static ErrorCode split_root(
-	//! [in] Root of the tree the nodes reside in
-	bptr_t *root,
 	//! [in] The node to split
 	AddrNode const *leaf,
 	//! [inout] The parent of the node to split
@@ -72,24 +103,19 @@ static ErrorCode split_root(
 	//! [in] The contents of the split node's new sibling
 	AddrNode const *sibling
 ) {
-	// If this is the only node
-	// We need to create the first inner node
-	if (is_leaf(leaf->addr)) {
-		// Make a new root node
-		*root = MAX_LEAVES;
-	} else {
-		if (*root + MAX_NODES_PER_LEVEL >= MEM_SIZE) {
-			return OUT_OF_MEMORY;
-		} else {
-			*root = *root + MAX_NODES_PER_LEVEL;
-		}
-	}
-	parent->addr = *root;
-	parent->node = mem_read_lock(parent->addr);
+	// The new root goes on the level above, which may not have existed yet
+	ErrorCode status = lock_empty_slot(
+		get_level(leaf->addr) + 1, get_region(leaf->addr), parent, NULL, 0);
+	if (status != SUCCESS) return status;
+	STATS_INC(root_splits);
 	init_node(&parent->node);
-	parent->node.keys[0] = leaf->node.keys[DIV2CEIL(TREE_ORDER)-1];
+	// The root is alone on its level and bounds nothing
+	parent->node.next = INVALID;
+	parent->node.low_key = INVALID;
+	parent->node.high_key = INVALID;
+	parent->node.keys[0] = leaf->node.high_key;
 	parent->node.values[0].ptr = leaf->addr;
-	parent->node.keys[1] = sibling->node.keys[(TREE_ORDER/2)-1];
+	parent->node.keys[1] = max(&sibling->node);
 	parent->node.values[1].ptr = sibling->addr;
 	return SUCCESS;
 }
@@ -99,8 +125,6 @@ static ErrorCode split_root(
 //! @return An error code representing the success or type of failure of the
 //!         operation
 static ErrorCode split_nonroot(
-	//! [in] Root of the tree the nodes reside in
-	bptr_t const *root,
 	//! [in] The node to split
 	AddrNode const *leaf,
 	//! [inout] The parent of the node to split
@@ -114,14 +138,19 @@ static ErrorCode split_nonroot(
 		for (li_t i = 0; i < TREE_ORDER; ++i) {
 			// Update key of old node
 			if (parent->node.values[i].ptr == leaf->addr) {
-				parent->node.keys[i] = leaf->node.keys[DIV2CEIL(TREE_ORDER)-1];
+				// The sibling takes over the old node's upper bound
+				bkey_t sibling_key = max(&sibling->node);
+				if (parent->node.keys[i] > sibling_key) {
+					sibling_key = parent->node.keys[i];
+				}
+				parent->node.keys[i] = leaf->node.high_key;
 				// Scoot over other nodes to fit in new node
 				for (li_t j = TREE_ORDER-1; j > i; --j) {
 					parent->node.keys[j] = parent->node.keys[j-1];
 					parent->node.values[j] = parent->node.values[j-1];
 				}
 				// Insert new node
-				parent->node.keys[i+1] = sibling->node.keys[(TREE_ORDER/2)-1];
+				parent->node.keys[i+1] = sibling_key;
 				parent->node.values[i+1].ptr = sibling->addr;
 				return SUCCESS;
 			}
@@ -132,17 +161,24 @@ static ErrorCode split_nonroot(
 
 
 ErrorCode split_node(
-	bptr_t *root, AddrNode *leaf, AddrNode *parent, AddrNode *sibling
+	AddrNode *leaf, AddrNode *parent, AddrNode *sibling, bkey_t key
 ) {
-	ErrorCode status = alloc_sibling(root, leaf, sibling);
+	// Appending to the end of a level, so the keys to come belong to the
+	// sibling and nothing more will be added to the split node
+	const li_t keep = (leaf->node.next == INVALID && key > max(&leaf->node))
+		? APPEND_SPLIT_KEEP : DIV2CEIL(TREE_ORDER);
+	ErrorCode status = alloc_sibling(leaf, keep, sibling);
 	if (status != SUCCESS) return status;
+	STATS_INC(splits[get_level(leaf->addr)]);
 	if (parent->addr == INVALID) {
-		status = split_root(root, leaf, parent, sibling);
+		status = split_root(leaf, parent, sibling);
 	} else {
-		status = split_nonroot(root, leaf, parent, sibling);
+		status = split_nonroot(leaf, parent, sibling);
 	}
-	if (status == SUCCESS) {
-		mem_write_unlock(parent);
+	if (status != SUCCESS && status != PARENT_FULL) {
+		// Give the slot back; the split node's copy must not be written
+		mem_unlock(sibling->addr);
+		free_slot(sibling->addr);
 	}
 	return status;
 }
@@ -3,21 +3,49 @@
 
 
 #include "types.h"
+#include <stddef.h>
 typedef struct AddrNode AddrNode;
 
 
 //! @brief Split a node in the tree and return the affected nodes
+//!
+//! None of the affected nodes are written back. To keep concurrent readers on
+//! a path to every key, the caller writes the sibling, then the parent, then
+//! the split node. A new root is left locked in @p parent and only becomes the
+//! root once the caller stores its address. On failure the sibling is
+//! released and the split node's copy is left modified and must be discarded.
+//!
+//! Nodes split evenly, except that the rightmost node on a level splitting
+//! for a key beyond all of its own keeps APPEND_SPLIT_KEEP entries.
 //! @return An error code representing the success or type of failure of the
 //!         operation
 ErrorCode split_node(
-	//! [inout] Root of the tree the nodes reside in
-	bptr_t *root,
 	//! [in] The node to split
 	AddrNode *leaf,
 	//! [inout] The parent of the node to split
 	AddrNode *parent,
 	//! [out] The contents of the split node's new sibling
-	AddrNode *sibling
+	AddrNode *sibling,
+	//! [in] The key to be inserted into the split node or its sibling
+	bkey_t key
+);
+
+
+//! @brief Find an empty slot on a level and lock it
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode lock_empty_slot(
+	//! [in] The level on which to allocate
+	uint_fast8_t level,
+	//! [in] The region of memory holding the tree the slot is for
+	bptr_t region,
+	//! [out] The locked slot and its contents
+	AddrNode *slot,
+	//! [in] Addresses of empty slots on the level which the caller has
+	//!      locked, and which must not be handed out again
+	bptr_t const *held,
+	//! [in] Number of held slots
+	size_t n_held
 );
 
 
@@ -0,0 +1,58 @@
+#include "stats.h"
+#include "memory.h"
+#include "node.h"
+#include <string.h>
+
+
+#if defined(TREE_STATS) && !defined(__SYNTHESIS__)
+STATS_THREAD_LOCAL OpStats thread_stats;
+
+
+void op_stats_reset() {
+	memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+
+void op_stats_merge(OpStats *total, OpStats const *stats) {
+	total->node_reads += stats->node_reads;
+	total->node_writes += stats->node_writes;
+	total->read_retries += stats->read_retries;
+	total->lock_acquires += stats->lock_acquires;
+	total->lock_spins += stats->lock_spins;
+	total->right_moves += stats->right_moves;
+	total->restarts += stats->restarts;
+	for (uint_fast8_t i = 0; i < MAX_LEVELS; ++i) {
+		total->splits[i] += stats->splits[i];
+	}
+	total->shifts += stats->shifts;
+	total->parent_full += stats->parent_full;
+	total->root_splits += stats->root_splits;
+	total->cache_hits += stats->cache_hits;
+	total->cache_misses += stats->cache_misses;
+}
+#endif
+
+
+void tree_stats(LevelStats *levels) {
+	Node node;
+
+	memset(levels, 0, MAX_LEVELS * sizeof(LevelStats));
+	for (bptr_t addr = 0; addr < MEM_SIZE; ++addr) {
+		// Memory may not have been handed to any level yet
+		if (get_level(addr) >= MAX_LEVELS) continue;
+		LevelStats *level = &levels[get_level(addr)];
+		node = mem_read(addr);
+		if (is_valid(&node)) {
+			level->nodes++;
+			level->keys += num_keys(&node);
+		} else {
+			level->free++;
+		}
+	}
+	for (uint_fast8_t i = 0; i < MAX_LEVELS; ++i) {
+		if (levels[i].nodes) {
+			levels[i].fill = (float) levels[i].keys
+				/ ((float) levels[i].nodes * TREE_ORDER);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include "types.h"
+
+
+//! Hot-path counters are only compiled in when building with `-DTREE_STATS`.
+//! Without it the counting macros expand to nothing.
+#if defined(TREE_STATS) && !defined(__SYNTHESIS__)
+
+#ifdef __cplusplus
+	#define STATS_THREAD_LOCAL thread_local
+#else
+	#define STATS_THREAD_LOCAL _Thread_local
+#endif
+
+//! @brief Counts of the work done by a single thread
+typedef struct {
+	//! @brief Nodes copied out of memory, with or without locking
+	uint64_t node_reads;
+	//! @brief Nodes written back to memory
+	uint64_t node_writes;
+	//! @brief Optimistic reads repeated because a writer got in the way
+	uint64_t read_retries;
+	//! @brief Locks taken
+	uint64_t lock_acquires;
+	//! @brief Failed attempts to take a lock which was already held
+	uint64_t lock_spins;
+	//! @brief Right links followed while holding a lock
+	uint64_t right_moves;
+	//! @brief Operations which started over from the root
+	uint64_t restarts;
+	//! @brief Nodes split, by level with the leaves at 0
+	uint64_t splits[MAX_LEVELS];
+	//! @brief Full nodes which made room by shifting entries into their right
+	//!        sibling instead of splitting, with `-DREDISTRIBUTE`
+	uint64_t shifts;
+	//! @brief Splits which had to go on to split the parent as well, counted
+	//!        as the parent splits
+	uint64_t parent_full;
+	//! @brief Splits of the root, each adding a level to the tree
+	uint64_t root_splits;
+	//! @brief Node reads served by the node cache, with `-DNODE_CACHE`
+	uint64_t cache_hits;
+	//! @brief Node reads which had to go to backing memory despite the node
+	//!        cache
+	uint64_t cache_misses;
+} OpStats;
+
+//! @brief The calling thread's counters
+extern STATS_THREAD_LOCAL OpStats thread_stats;
+
+//! @brief Zero the calling thread's counters
+void op_stats_reset();
+
+//! @brief Add one set of counters onto another, such as to total up several
+//!        threads
+//! @param[inout] total  Running total
+//! @param[in]    stats  Counters to add
+void op_stats_merge(OpStats *total, OpStats const *stats);
+
+#define STATS_ADD(field, n) ((void) (thread_stats.field += (n)))
+
+#else
+
+#define STATS_ADD(field, n) ((void) 0)
+
+#endif
+
+//! @brief Count an event in the calling thread's counters
+#define STATS_INC(field) STATS_ADD(field, 1)
+
+
+//! @brief Occupancy of one level of the memory grid
+typedef struct {
+	//! @brief Slots holding a node
+	bptr_t nodes;
+	//! @brief Slots available for new nodes
+	bptr_t free;
+	//! @brief Entries held across all of the level's nodes
+	uint64_t keys;
+	//! @brief Fraction of the level's nodes' entries in use, 0 if it is empty
+	float fill;
+} LevelStats;
+
+//! @brief Survey the memory grid level by level
+//!
+//! Reads every slot, so this is meant for monitoring rather than the hot
+//! path. Concurrent writers may leave the figures slightly out of date.
+//! @param[out] levels  Array of MAX_LEVELS entries, the leaves first
+void tree_stats(LevelStats *levels);
+
+
+#endif
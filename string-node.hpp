@@ -0,0 +1,479 @@
+#ifndef STRING_NODE_HPP
+#define STRING_NODE_HPP
+
+//! @file string-node.hpp
+//! @brief Node type for @ref blink::BLinkTree with variable-length string keys
+//!
+//! Each node keeps its keys' bytes in a heap at its end, and its slot array
+//! holds only a fixed-width slice of each key, so that the binary search in
+//! @ref blink::StringNode::rank touches the heap only when two slices tie.
+//! Bytes shared by every key between a node's fence keys are stored once, as
+//! part of the low fence, and left out of both the slices and the heap.
+//! Splitting a leaf picks, among split points near the middle, the one which
+//! allows the shortest separator, and stores only as much of it as is needed
+//! to tell the two halves apart. Keys shorter than the prefix and slice
+//! together take no heap space at all.
+
+
+#include "blink-tree.hpp"
+#include <string>
+#include <string_view>
+
+
+namespace blink {
+
+
+//! @brief A node of string keys, standing in for @ref Node
+//! @tparam Value  Trivially copyable data stored in the leaves
+//! @tparam Order  Most keys a node can hold
+//! @tparam Bytes  Size of each node's key heap
+template <typename Value, std::size_t Order = 64, std::size_t Bytes = 1024,
+	typename Ptr = std::uint32_t>
+struct StringNode {
+	static_assert(Order >= 4 && Order % 2 == 0,
+		"Nodes split near the middle, so the order must be even");
+	static_assert(Bytes >= 256 && Bytes < 0xFFFF,
+		"Heap offsets and lengths are 16 bits");
+	static_assert(std::is_trivially_copyable_v<Value>
+			&& std::is_trivially_default_constructible_v<Value>,
+		"Values are copied as raw memory");
+
+	using key_type = std::string;
+	using key_view = std::string_view;
+	using value_type = Value;
+	using ptr_type = Ptr;
+	static constexpr std::size_t order = Order;
+	static constexpr Ptr invalid_ptr = std::numeric_limits<Ptr>::max();
+	//! @brief Longest key the tree takes, short enough that either half of a
+	//!        split node, along with its new fences, has room for the key
+	//!        which made it split
+	static constexpr std::size_t max_key_length = Bytes / 10;
+
+	//! @brief Address of a child in inner nodes, or data in leaves
+	union Entry {
+		Ptr ptr;
+		Value data;
+	};
+
+	//! @brief A key's entry in the slot array
+	struct Slot {
+		//! @brief The key's first four bytes after the prefix, big-endian and
+		//!        padded with zeroes, so that slices order like the keys
+		std::uint32_t slice;
+		//! @brief Where the key's bytes after the slice start in the heap
+		std::uint16_t offset;
+		//! @brief Length of the key after the prefix
+		std::uint16_t length;
+	};
+
+	//! @brief A fence key, stored whole in the heap
+	struct Fence {
+		std::uint16_t offset;
+		//! @brief Length of the key, or @ref absent if there is no bound
+		std::uint16_t length;
+	};
+	static constexpr std::uint16_t absent = 0xFFFF;
+
+	//! @brief Keys in increasing order, followed by unused slots
+	Slot slots[Order];
+	//! @brief The entries corresponding to the keys at the same indices
+	Entry values[Order];
+	//! @brief Address of the next node on the same level
+	Ptr next;
+	//! @brief Number of keys in use
+	std::uint16_t count;
+	//! @brief Length of the prefix shared by every key between the fences,
+	//!        which is the start of the low fence
+	std::uint16_t prefix;
+	//! @brief End of the heap space handed out so far
+	std::uint16_t top;
+	//! @brief Heap bytes still referenced, the rest being garbage until the
+	//!        heap is compacted
+	std::uint16_t live;
+	//! @brief Exclusive lower bound on the keys held in or beneath this node
+	Fence low_key;
+	//! @brief Upper bound on the keys held in or beneath this node
+	Fence high_key;
+	char heap[Bytes];
+
+	bool is_valid() const { return count != 0; }
+	bool is_full() const { return count == Order; }
+	std::size_t num_keys() const { return count; }
+
+	//! @brief Whether a key can be stored in the tree at all
+	static bool storable(key_view key) { return key.size() <= max_key_length; }
+
+	//! @brief Whether @ref insert_nonfull has room for a key
+	//!
+	//! Room for one more key of the greatest length is always kept spare, so
+	//! that an inner node can take a new separator in place of an old one
+	//! just before it splits.
+	bool has_room(key_view key) const {
+		return count < Order && fits(tail_length(suffix_length(key)));
+	}
+
+	//! @brief Number of keys less than the given key, equivalently the index
+	//!        of the first key greater than or equal to it
+	//! @param[out] found  Whether the key at that index is the given key
+	std::size_t rank(key_view key, bool &found) const {
+		found = false;
+		// Keys not starting with the prefix sort before or after them all
+		const int outside = key.substr(0, prefix).compare(prefix_bytes());
+		if (outside < 0) return 0;
+		if (outside > 0) return count;
+		const key_view suffix = key.substr(prefix);
+		const std::uint32_t slice = slice_of(suffix);
+		std::size_t lo = 0, hi = count;
+		while (lo < hi) {
+			const std::size_t mid = (lo + hi) / 2;
+			const int order = compare(suffix, slice, slots[mid]);
+			if (order > 0) {
+				lo = mid + 1;
+			} else {
+				found = (order == 0);
+				hi = mid;
+			}
+		}
+		found = found && lo < count;
+		return lo;
+	}
+
+	std::size_t rank(key_view key) const {
+		bool found;
+		return rank(key, found);
+	}
+
+	//! @brief The key at an index, rebuilt from its prefix, slice and tail
+	std::string key_at(std::size_t i) const {
+		Slot const &slot = slots[i];
+		std::string key(prefix_bytes());
+		for (std::size_t j = 0; j < 4 && j < slot.length; ++j) {
+			key.push_back(static_cast<char>(slot.slice >> (24 - 8*j)));
+		}
+		key.append(tail(slot));
+		return key;
+	}
+
+	//! @brief The largest key, or an empty one if there are none
+	std::string max() const { return count ? key_at(count-1) : std::string(); }
+
+	//! @brief See @ref past_high_key
+	bool past_high_key(key_view key) const {
+		return high_key.length != absent && key > fence(high_key)
+			&& next != invalid_ptr;
+	}
+
+	//! @brief See @ref before_low_key
+	bool before_low_key(key_view key) const {
+		return low_key.length != absent && key <= fence(low_key);
+	}
+
+	//! @brief Empty this node's contents and restore its default state
+	void clear() {
+		count = 0;
+		prefix = 0;
+		top = 0;
+		live = 0;
+		low_key = Fence{0, absent};
+		high_key = Fence{0, absent};
+	}
+
+	//! @brief See @ref find_next
+	//! @param[in]  key   The key to search for
+	//! @param[out] addr  The next node to check on success
+	ErrorCode find_next(key_view key, Ptr &addr) const {
+		if (past_high_key(key)) {
+			addr = next;
+			return SUCCESS;
+		}
+		const std::size_t i = rank(key);
+		if (i < count) {
+			addr = values[i].ptr;
+		} else if (count == 0) {
+			return NOT_FOUND;
+		} else if (count < Order || next == invalid_ptr) {
+			addr = values[count-1].ptr;
+		} else {
+			addr = next;
+		}
+		return SUCCESS;
+	}
+
+	//! @brief See @ref find_value
+	ErrorCode find_value(key_view key, Value &value) const {
+		bool found;
+		const std::size_t i = rank(key, found);
+		if (!found) return NOT_FOUND;
+		value = values[i].data;
+		return SUCCESS;
+	}
+
+	//! @brief See @ref find_child
+	std::size_t find_child(Ptr child) const {
+		for (std::size_t i = 0; i < count; ++i) {
+			if (values[i].ptr == child) return i;
+		}
+		return Order;
+	}
+
+	//! @brief Insert into a node which has room, keeping keys in order
+	ErrorCode insert_nonfull(key_view key, Entry value) {
+		bool found;
+		const std::size_t at = rank(key, found);
+		if (found) return KEY_EXISTS;
+		if (!has_room(key)) return OUT_OF_MEMORY;
+		// Only keys between the fences belong here, and they have the prefix
+		if (key.substr(0, prefix) != prefix_bytes()) return INVALID_ARGUMENT;
+		place(at, key, value);
+		return SUCCESS;
+	}
+
+	//! @brief Replace the key at an index without changing its value
+	//!
+	//! The key must lie between the fences. There is always room, since
+	//! @ref has_room keeps space spare for it.
+	void rekey_at(std::size_t i, key_view key) {
+		live -= tail_length(slots[i].length);
+		// Keep a compaction from copying the old tail
+		slots[i].length = 0;
+		slots[i] = make_slot(key.substr(prefix));
+	}
+
+	//! @brief Move the keys above a split point into an empty sibling
+	//!
+	//! The split point is chosen near the middle such that either half has
+	//! at most a little over half of the heap's contents. For leaves, it is
+	//! also the one allowing the shortest separator, which is then truncated
+	//! to the shortest string that falls between the two halves. Separators
+	//! in inner nodes bound their children's keys, so are kept whole. The
+	//! sibling inherits this node's range above the separator. Right links
+	//! are left to the caller.
+	//! @param[in] leaf  Whether the node is a leaf
+	//! @return The separator, now this node's high key
+	std::string split(StringNode &sibling, bool leaf) {
+		const std::size_t n = count;
+		std::string keys[Order];
+		Entry entries[Order];
+		std::size_t weight[Order];
+		std::size_t total = 0;
+		for (std::size_t i = 0; i < n; ++i) {
+			keys[i] = key_at(i);
+			entries[i] = values[i];
+			// New prefixes are no shorter, so tails can only shrink
+			weight[i] = tail_length(slots[i].length);
+			total += weight[i];
+		}
+		const bool has_low = low_key.length != absent;
+		const bool has_high = high_key.length != absent;
+		const std::string low(has_low ? fence(low_key) : key_view());
+		const std::string high(has_high ? fence(high_key) : key_view());
+
+		// Fall back to the byte-balanced split nearest the middle if none is
+		// also close to it by count
+		const std::size_t limit = total / 2 + max_key_length;
+		const std::size_t first = std::max<std::size_t>(n / 4, 1);
+		const std::size_t last = std::min(n - n / 4, n - 1);
+		std::size_t at = 0, left = 0, best_length = 0, best_distance = 0;
+		for (std::size_t i = 1; i < n; ++i) {
+			left += weight[i-1];
+			if (left > limit || total - left > limit) continue;
+			const std::size_t length = (i >= first && i <= last)
+				? separator(keys[i-1], keys[i], leaf).size()
+				: max_key_length + 1;
+			const std::size_t distance = (i > n/2) ? i - n/2 : n/2 - i;
+			if (!at || length < best_length
+				|| (length == best_length && distance < best_distance)) {
+				at = i;
+				best_length = length;
+				best_distance = distance;
+			}
+		}
+		const std::string separator = StringNode::separator(
+			keys[at-1], keys[at], leaf);
+
+		sibling.build(keys + at, entries + at, n - at,
+			&separator, has_high ? &high : nullptr);
+		build(keys, entries, at, has_low ? &low : nullptr, &separator);
+		return separator;
+	}
+
+	//! @brief Become a root over two children, bounding nothing
+	void make_root(key_view left_key, Ptr left, key_view right_key, Ptr right) {
+		const std::string keys[2] = {
+			std::string(left_key), std::string(right_key)};
+		Entry entries[2];
+		entries[0].ptr = left;
+		entries[1].ptr = right;
+		next = invalid_ptr;
+		build(keys, entries, 2, nullptr, nullptr);
+	}
+
+	//! @brief Record that the child at an index has split
+	//! @param[in] i            Index of the child which split
+	//! @param[in] left_key     The child's new upper bound
+	//! @param[in] sibling_key  Upper bound of the child's new sibling
+	//! @param[in] sibling      Address of the new sibling
+	//! @return PARENT_FULL if there is no room, otherwise SUCCESS
+	ErrorCode add_split_child(
+		std::size_t i, key_view left_key, key_view sibling_key, Ptr sibling
+	) {
+		if (count == Order || !fits(tail_length(suffix_length(left_key))
+				+ tail_length(suffix_length(sibling_key)))) {
+			return PARENT_FULL;
+		}
+		rekey_at(i, left_key);
+		Entry entry;
+		entry.ptr = sibling;
+		place(i + 1, sibling_key, entry);
+		return SUCCESS;
+	}
+
+private:
+	//! @brief Big-endian first four bytes of a string, padded with zeroes
+	static std::uint32_t slice_of(key_view s) {
+		std::uint32_t slice = 0;
+		for (std::size_t i = 0; i < 4; ++i) {
+			slice = (slice << 8)
+				| (i < s.size() ? static_cast<unsigned char>(s[i]) : 0);
+		}
+		return slice;
+	}
+
+	//! @brief Bytes of a key kept in the heap, given its length after the
+	//!        prefix
+	static std::size_t tail_length(std::size_t length) {
+		return (length > 4) ? length - 4 : 0;
+	}
+
+	std::size_t suffix_length(key_view key) const {
+		return (key.size() > prefix) ? key.size() - prefix : 0;
+	}
+
+	bool fits(std::size_t bytes) const {
+		return live + bytes + max_key_length <= Bytes;
+	}
+
+	static std::uint16_t length_of(std::string const &s) {
+		return static_cast<std::uint16_t>(s.size());
+	}
+
+	key_view fence(Fence f) const { return key_view(heap + f.offset, f.length); }
+	key_view prefix_bytes() const {
+		return key_view(heap + low_key.offset, prefix);
+	}
+	key_view tail(Slot const &slot) const {
+		return key_view(heap + slot.offset, tail_length(slot.length));
+	}
+
+	//! @brief Compare a key, less the prefix, with the key in a slot
+	//! @return Negative, zero or positive as the key is less than, equal to or
+	//!         greater than the slot's
+	int compare(key_view suffix, std::uint32_t slice, Slot const &slot) const {
+		if (slice != slot.slice) return (slice < slot.slice) ? -1 : 1;
+		const key_view rest =
+			(suffix.size() > 4) ? suffix.substr(4) : key_view();
+		const int order = rest.compare(tail(slot));
+		if (order != 0) return order;
+		// Padding hides the difference between short keys and zero bytes
+		return (suffix.size() > slot.length) - (suffix.size() < slot.length);
+	}
+
+	//! @brief Separator between two adjacent keys
+	//!
+	//! In leaves, this is the higher key up to one byte past the common
+	//! prefix, the shortest string greater than or equal to the lower key and
+	//! less than the higher, unless that would be the whole higher key.
+	static std::string separator(
+		std::string const &lower, std::string const &higher, bool leaf
+	) {
+		if (!leaf) return lower;
+		std::size_t common = 0;
+		while (common < lower.size() && common < higher.size()
+			&& lower[common] == higher[common]) {
+			++common;
+		}
+		return (common + 1 < higher.size()) ? higher.substr(0, common + 1)
+			: lower;
+	}
+
+	//! @brief Copy bytes into the heap, compacting it first if needed
+	//! @return Offset of the copy
+	std::uint16_t store(key_view bytes) {
+		if (top + bytes.size() > Bytes) compact();
+		const std::uint16_t offset = top;
+		if (!bytes.empty()) std::memcpy(heap + top, bytes.data(), bytes.size());
+		top += bytes.size();
+		live += bytes.size();
+		return offset;
+	}
+
+	//! @brief Move everything still referenced to the start of the heap
+	void compact() {
+		char old[Bytes];
+		std::memcpy(old, heap, top);
+		top = 0;
+		live = 0;
+		auto keep = [&](std::uint16_t &offset, std::size_t length) {
+			std::memcpy(heap + top, old + offset, length);
+			offset = top;
+			top += length;
+			live += length;
+		};
+		if (low_key.length != absent) keep(low_key.offset, low_key.length);
+		if (high_key.length != absent) keep(high_key.offset, high_key.length);
+		for (std::size_t i = 0; i < count; ++i) {
+			keep(slots[i].offset, tail_length(slots[i].length));
+		}
+	}
+
+	Slot make_slot(key_view suffix) {
+		Slot slot;
+		slot.slice = slice_of(suffix);
+		slot.length = suffix.size();
+		slot.offset = store(tail_length(suffix.size()) ? suffix.substr(4)
+			: key_view());
+		return slot;
+	}
+
+	//! @brief Insert a key known to have room at an index
+	void place(std::size_t at, key_view key, Entry value) {
+		// Store first, since compaction only knows the slots in use
+		const Slot slot = make_slot(key.substr(prefix));
+		std::memmove(slots + at + 1, slots + at, (count - at) * sizeof(Slot));
+		std::memmove(values + at + 1, values + at, (count - at) * sizeof(Entry));
+		slots[at] = slot;
+		values[at] = value;
+		++count;
+	}
+
+	//! @brief Refill this node from scratch, leaving its right link alone
+	//! @param[in] low   Exclusive lower bound, or null if there is none
+	//! @param[in] high  Upper bound, or null if there is none
+	void build(
+		std::string const *keys, Entry const *entries, std::size_t n,
+		std::string const *low, std::string const *high
+	) {
+		const Ptr link = next;
+		clear();
+		next = link;
+		if (low) low_key = Fence{store(*low), length_of(*low)};
+		if (high) high_key = Fence{store(*high), length_of(*high)};
+		if (low && high) {
+			while (prefix < low->size() && prefix < high->size()
+				&& (*low)[prefix] == (*high)[prefix]) {
+				++prefix;
+			}
+		}
+		for (std::size_t i = 0; i < n; ++i) {
+			slots[i] = make_slot(key_view(keys[i]).substr(prefix));
+			values[i] = entries[i];
+			++count;
+		}
+	}
+};
+
+
+} // namespace blink
+
+
+#endif
@@ -0,0 +1,270 @@
+//! @file concurrent-readers.c
+//! @brief Check that lock-free readers see every key while writers split the
+//!        nodes under them
+//!
+//! Each round bulk loads a tree of even keys. Writer threads then insert the
+//! odd keys between them, erase them and insert them again, in an order that
+//! spreads their splits and merges over the whole tree. Meanwhile reader
+//! threads look up the preloaded keys with @ref search and
+//! @ref search_batch and page through short @ref scan ranges. Any preloaded
+//! key a reader fails to find, or finds with the wrong value, counts as a
+//! miss. Once the writers are done, the tree must hold exactly the preloaded
+//! and inserted keys. Build from the
+//! repository root against the host memory backend, or let test/run.sh build
+//! it in several configurations:
+//!
+//!     cc -O2 -pthread -DATOMIC_LOCKS -DTREE_ORDER=4
+//!         -DMAX_NODES_PER_LEVEL=16384 -DMAX_LEVELS=10 -I.
+//!         test/concurrent-readers.c alloc.c bulk-load.c erase.c insert.c
+//!         insert-helpers.c memory-host.c node.c scan.c search.c split.c
+//!         tree-helpers.c -o concurrent-readers
+//!
+//! Usage: `concurrent-readers [rounds] [readers] [writers] [base keys]`
+
+#include "alloc.h"
+#include "bulk-load.h"
+#include "erase.h"
+#include "insert.h"
+#include "memory.h"
+#include "scan.h"
+#include "search.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//! @brief Keys looked up by each call to @ref search_batch
+#define BATCH (32)
+//! @brief Entries visited by each scan
+#define SCAN_LENGTH (16)
+//! @brief Times each writer erases its keys and inserts them again
+#define PASSES (2)
+
+
+//! @brief Work shared by every thread of a round
+typedef struct {
+	bptr_t *root;
+	//! @brief Number of preloaded keys, which are 2, 4, 6 and so on
+	size_t n_base;
+	size_t n_writers;
+	//! @brief Number of writers still inserting
+	atomic_size_t writing;
+	//! @brief Set to the number of inserts and erases which failed
+	atomic_size_t failed;
+	//! @brief Set to the number of lookups which missed
+	atomic_size_t misses;
+} Round;
+
+//! @brief A thread's share of a round
+typedef struct {
+	Round *round;
+	size_t thread;
+} Worker;
+
+//! @brief Progress of a reader's scan
+typedef struct {
+	//! @brief Next key to visit, which may be skipped if it is odd
+	bkey_t expected;
+	size_t misses;
+} ScanCheck;
+
+
+//! @brief xorshift64* pseudorandom number generator
+static uint64_t next_rand(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//! @brief Value stored under a key, so that readers can tell it is right
+static bval_t value_of(bkey_t key) {
+	return (bval_t) {.data = (bdata_t) (key * 2654435761u >> 1)};
+}
+
+//! @brief Index of the i-th odd key to insert, spread over the whole range by
+//!        stepping through it in bit-reversed order
+static size_t spread(size_t i, unsigned bits) {
+	size_t r = 0;
+	for (unsigned b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+	return r;
+}
+
+//! @brief Insert a writer's share of the odd keys, then erase and insert
+//!        them again, so that nodes are merged and reused under the readers
+static void *write_keys(void *arg) {
+	Worker *w = arg;
+	Round *round = w->round;
+	unsigned bits = 0;
+
+	while (((size_t) 1 << bits) < round->n_base) ++bits;
+	for (size_t pass = 0; pass < 2*PASSES + 1; ++pass) {
+		for (size_t i = w->thread; i < (size_t) 1 << bits;
+			i += round->n_writers) {
+			const size_t j = spread(i, bits);
+			if (j >= round->n_base) continue;
+			const bkey_t key = 2*j + 1;
+			const ErrorCode status = (pass & 1)
+				? erase(round->root, key)
+				: insert(round->root, key, value_of(key));
+			if (status != SUCCESS) atomic_fetch_add(&round->failed, 1);
+		}
+	}
+	atomic_fetch_sub(&round->writing, 1);
+	return NULL;
+}
+
+//! @brief Check that a scan visits every preloaded key in order, each
+//!        optionally followed by the odd key above it
+static bool check_entry(bkey_t key, bval_t value, void *ctx) {
+	ScanCheck *check = ctx;
+	const bool optional = check->expected & 1;
+	if (value.data != value_of(key).data || (key != check->expected
+		&& !(optional && key == check->expected + 1))) {
+		check->misses++;
+		return false;
+	}
+	check->expected = key + 1;
+	return true;
+}
+
+//! @brief Look up preloaded keys until the writers are done
+static void *read_keys(void *arg) {
+	Worker *w = arg;
+	Round *round = w->round;
+	uint64_t rng = 88172645463325252ULL + w->thread;
+	bkey_t keys[BATCH];
+	bstatusval_t results[BATCH];
+	size_t misses = 0;
+
+	while (atomic_load(&round->writing) > 0) {
+		const bkey_t key = 2 * (1 + next_rand(&rng) % round->n_base);
+		const bstatusval_t result = search(*round->root, key);
+		if (result.status != SUCCESS
+			|| result.value.data != value_of(key).data) {
+			misses++;
+		}
+
+		for (size_t i = 0; i < BATCH; ++i) {
+			keys[i] = 2 * (1 + next_rand(&rng) % round->n_base);
+		}
+		search_batch(*round->root, keys, BATCH, results);
+		for (size_t i = 0; i < BATCH; ++i) {
+			if (results[i].status != SUCCESS
+				|| results[i].value.data != value_of(keys[i]).data) {
+				misses++;
+			}
+		}
+
+		const bkey_t lo = 2 * (1 + next_rand(&rng) % round->n_base);
+		ScanCheck check = {lo, 0};
+		ScanCursor cursor;
+		scan_init(&cursor, lo, INVALID);
+		if (scan(*round->root, &cursor, SCAN_LENGTH, check_entry, &check, NULL)
+			!= SUCCESS) {
+			check.misses++;
+		}
+		misses += check.misses;
+	}
+	atomic_fetch_add(&round->misses, misses);
+	return NULL;
+}
+
+//! @brief Check that the tree holds exactly the preloaded and inserted keys
+//! @return Number of keys which are missing, wrong or unexpected
+static size_t check_contents(bptr_t root, size_t n_base) {
+	const bkey_t last = 2 * n_base;
+	ScanCursor cursor;
+	bkey_t keys[256];
+	bval_t values[256];
+	bkey_t expected = 1;
+	size_t count, wrong = 0;
+
+	scan_init(&cursor, 0, INVALID);
+	while (!cursor.done) {
+		if (scan_buffer(root, &cursor, keys, values, 256, &count) != SUCCESS) {
+			return wrong + 1;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			if (keys[i] != expected
+				|| values[i].data != value_of(keys[i]).data) {
+				wrong++;
+			}
+			expected = keys[i] + 1;
+		}
+	}
+	if (expected != last + 1) wrong++;
+	for (bkey_t key = 1; key <= last; ++key) {
+		const bstatusval_t result = search(root, key);
+		if (result.status != SUCCESS
+			|| result.value.data != value_of(key).data) {
+			wrong++;
+		}
+	}
+	return wrong;
+}
+
+
+int main(int argc, char **argv) {
+	const size_t n_rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 10;
+	const size_t n_readers = (argc > 2) ? strtoul(argv[2], NULL, 0) : 3;
+	const size_t n_writers = (argc > 3) ? strtoul(argv[3], NULL, 0) : 2;
+	const size_t n_base = (argc > 4) ? strtoul(argv[4], NULL, 0) : 6000;
+	const size_t n_threads = n_readers + n_writers;
+	bkey_t *keys = malloc(n_base * sizeof(bkey_t));
+	bval_t *values = malloc(n_base * sizeof(bval_t));
+	pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+	Worker *workers = malloc(n_threads * sizeof(Worker));
+	bptr_t root;
+	ErrorCode status;
+	size_t wrong;
+
+	if (!keys || !values || !threads || !workers || n_writers == 0) {
+		fprintf(stderr, "Allocation failed or no writers\n");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_base; ++i) {
+		keys[i] = 2*i + 2;
+		values[i] = value_of(keys[i]);
+	}
+
+	for (size_t r = 0; r < n_rounds; ++r) {
+		Round round = {
+			.root = &root, .n_base = n_base, .n_writers = n_writers,
+			.writing = n_writers, .failed = 0, .misses = 0
+		};
+		root = 0;
+		mem_reset_all();
+		alloc_rebuild();
+		// Full leaves, so that nearly every insert splits one
+		status = bulk_load(&root, keys, values, n_base, TREE_ORDER);
+		if (status != SUCCESS) {
+			fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+			return EXIT_FAILURE;
+		}
+
+		for (size_t t = 0; t < n_threads; ++t) {
+			workers[t] = (Worker) {&round, t < n_writers ? t : t - n_writers};
+			pthread_create(&threads[t], NULL,
+				t < n_writers ? write_keys : read_keys, &workers[t]);
+		}
+		for (size_t t = 0; t < n_threads; ++t) pthread_join(threads[t], NULL);
+
+		wrong = check_contents(root, n_base);
+		if (round.failed || round.misses || wrong) {
+			fprintf(stderr, "Round %zu: %zu failed inserts, %zu reader misses, "
+				"%zu wrong keys at the end\n",
+				r, (size_t) round.failed, (size_t) round.misses, wrong);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("concurrent-readers: %zu rounds with %zu readers and %zu writers "
+		"passed\n", n_rounds, n_readers, n_writers);
+	free(workers);
+	free(threads);
+	free(values);
+	free(keys);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+//! @file concurrent-writers.c
+//! @brief Check that writers contending for the same leaves neither lose nor
+//!        duplicate keys
+//!
+//! Each round bulk loads a tree of keys spaced @ref GAP + 1 apart with
+//! leaves just over half full, and then has writer threads fill the gaps in
+//! a narrow hot range, with neighbouring keys going to different threads so
+//! that they lock the same leaves and split the same parents. Writers insert
+//! their keys, erase them, insert them again and finally erase every other
+//! one, while reader threads look up the preloaded keys in the hot range,
+//! which are never erased. A preloaded key a reader fails to find counts as
+//! a miss. Once the writers are done, a scan of the tree must give exactly
+//! the expected keys, once each and in order. Build from the repository root
+//! against the host memory backend, or let test/run.sh build it in several
+//! configurations:
+//!
+//!     cc -O2 -pthread -DATOMIC_LOCKS -DTREE_ORDER=4
+//!         -DMAX_NODES_PER_LEVEL=16384 -DMAX_LEVELS=10 -I.
+//!         test/concurrent-writers.c alloc.c bulk-load.c erase.c insert.c
+//!         insert-helpers.c memory-host.c node.c scan.c search.c split.c
+//!         tree-helpers.c -o concurrent-writers
+//!
+//! Usage: `concurrent-writers [rounds] [readers] [writers] [hot keys]`
+
+#include "alloc.h"
+#include "bulk-load.h"
+#include "erase.h"
+#include "insert.h"
+#include "memory.h"
+#include "scan.h"
+#include "search.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//! @brief Keys written into each gap between preloaded keys
+#define GAP 3
+//! @brief Preloaded keys on either side of the hot range, so that it does
+//!        not start at an edge of the tree
+#define MARGIN (1024)
+
+
+//! @brief Work shared by every thread of a round
+typedef struct {
+	bptr_t *root;
+	//! @brief Number of preloaded keys in the hot range
+	size_t hot;
+	size_t n_writers;
+	//! @brief Number of writers still writing
+	atomic_size_t writing;
+	//! @brief Set to the number of inserts and erases which failed
+	atomic_size_t failed;
+	//! @brief Set to the number of lookups which missed
+	atomic_size_t misses;
+} Round;
+
+//! @brief A thread's share of a round
+typedef struct {
+	Round *round;
+	size_t thread;
+} Worker;
+
+
+//! @brief xorshift64* pseudorandom number generator
+static uint64_t next_rand(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//! @brief Value stored under a key, so that readers can tell it is right
+static bval_t value_of(bkey_t key) {
+	return (bval_t) {.data = (bdata_t) (key * 2654435761u >> 1)};
+}
+
+//! @brief The i-th preloaded key
+static bkey_t base_key(size_t i) {
+	return (GAP+1) * (i + 1);
+}
+
+//! @brief Key of the i-th write across all threads
+//!
+//! Consecutive writes go to neighbouring gaps, and so are made by different
+//! threads into the same few leaves.
+static bkey_t hot_key(size_t i, size_t hot) {
+	return base_key(MARGIN + i % hot) + 1 + i / hot;
+}
+
+//! @brief Whether a key written into a gap is still in the tree at the end
+static bool kept(bkey_t key) {
+	return key % (GAP+1) != 2;
+}
+
+//! @brief Insert a writer's keys, erase them, insert them again and erase
+//!        some of them
+static void *write_keys(void *arg) {
+	Worker *w = arg;
+	Round *round = w->round;
+	ErrorCode status;
+
+	for (unsigned pass = 0; pass < 4; ++pass) {
+		for (size_t i = w->thread; i < GAP * round->hot; i += round->n_writers) {
+			const bkey_t key = hot_key(i, round->hot);
+			if (pass == 3 && kept(key)) continue;
+			status = (pass & 1)
+				? erase(round->root, key)
+				: insert(round->root, key, value_of(key));
+			if (status != SUCCESS) atomic_fetch_add(&round->failed, 1);
+		}
+	}
+	atomic_fetch_sub(&round->writing, 1);
+	return NULL;
+}
+
+//! @brief Look up preloaded keys in the hot range until the writers are done
+static void *read_keys(void *arg) {
+	Worker *w = arg;
+	Round *round = w->round;
+	uint64_t rng = 88172645463325252ULL + w->thread;
+	size_t misses = 0;
+
+	while (atomic_load(&round->writing) > 0) {
+		const bkey_t key = base_key(MARGIN + next_rand(&rng) % round->hot);
+		const bstatusval_t result = search(*round->root, key);
+		if (result.status != SUCCESS
+			|| result.value.data != value_of(key).data) {
+			misses++;
+		}
+	}
+	atomic_fetch_add(&round->misses, misses);
+	return NULL;
+}
+
+//! @brief Check that a scan of the tree gives exactly the preloaded keys and
+//!        the written keys which were kept, once each
+//! @return Number of keys which are missing, wrong, repeated or unexpected
+static size_t check_contents(bptr_t root, size_t n_base, size_t hot) {
+	const bkey_t hot_lo = base_key(MARGIN);
+	const bkey_t hot_hi = base_key(MARGIN + hot);
+	ScanCursor cursor;
+	bkey_t keys[256];
+	bval_t values[256];
+	bkey_t expected = base_key(0);
+	size_t count, wrong = 0;
+
+	scan_init(&cursor, 0, INVALID);
+	while (!cursor.done) {
+		if (scan_buffer(root, &cursor, keys, values, 256, &count) != SUCCESS) {
+			return wrong + 1;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			if (keys[i] != expected
+				|| values[i].data != value_of(keys[i]).data) {
+				wrong++;
+			}
+			// The next key is in the same gap if it was kept, else the
+			// next preloaded one
+			expected = keys[i] + 1;
+			while (expected % (GAP+1) != 0
+				&& (expected < hot_lo || expected > hot_hi || !kept(expected))) {
+				++expected;
+			}
+		}
+	}
+	if (expected != base_key(n_base)) wrong++;
+	return wrong;
+}
+
+
+int main(int argc, char **argv) {
+	const size_t n_rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 10;
+	const size_t n_readers = (argc > 2) ? strtoul(argv[2], NULL, 0) : 2;
+	const size_t n_writers = (argc > 3) ? strtoul(argv[3], NULL, 0) : 4;
+	const size_t hot = (argc > 4) ? strtoul(argv[4], NULL, 0) : 512;
+	const size_t n_base = hot + 2*MARGIN;
+	const size_t n_threads = n_readers + n_writers;
+	bkey_t *keys = malloc(n_base * sizeof(bkey_t));
+	bval_t *values = malloc(n_base * sizeof(bval_t));
+	pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+	Worker *workers = malloc(n_threads * sizeof(Worker));
+	bptr_t root;
+	ErrorCode status;
+	size_t wrong;
+
+	if (!keys || !values || !threads || !workers || n_writers == 0) {
+		fprintf(stderr, "Allocation failed or no writers\n");
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < n_base; ++i) {
+		keys[i] = base_key(i);
+		values[i] = value_of(keys[i]);
+	}
+
+	for (size_t r = 0; r < n_rounds; ++r) {
+		Round round = {
+			.root = &root, .hot = hot, .n_writers = n_writers,
+			.writing = n_writers, .failed = 0, .misses = 0
+		};
+		root = 0;
+		mem_reset_all();
+		alloc_rebuild();
+		status = bulk_load(&root, keys, values, n_base, TREE_ORDER/2 + 1);
+		if (status != SUCCESS) {
+			fprintf(stderr, "Bulk load failed: %s\n", ERROR_CODE_NAMES[status]);
+			return EXIT_FAILURE;
+		}
+
+		for (size_t t = 0; t < n_threads; ++t) {
+			workers[t] = (Worker) {&round, t < n_writers ? t : t - n_writers};
+			pthread_create(&threads[t], NULL,
+				t < n_writers ? write_keys : read_keys, &workers[t]);
+		}
+		for (size_t t = 0; t < n_threads; ++t) pthread_join(threads[t], NULL);
+
+		wrong = check_contents(root, n_base, hot);
+		if (round.failed || round.misses || wrong) {
+			fprintf(stderr, "Round %zu: %zu failed writes, %zu reader misses, "
+				"%zu wrong keys at the end\n",
+				r, (size_t) round.failed, (size_t) round.misses, wrong);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("concurrent-writers: %zu rounds with %zu readers and %zu writers "
+		"passed\n", n_rounds, n_readers, n_writers);
+	free(workers);
+	free(threads);
+	free(values);
+	free(keys);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+//! @file random-ops.c
+//! @brief Check random inserts, batch inserts, erases, searches and scans
+//!        against a reference
+//!
+//! Runs a long random sequence of operations on one thread, keeping a plain
+//! array of which keys should be in the tree and under which value, and
+//! stops at the first result the tree disagrees on. The sequence alternates
+//! between growing and shrinking the tree, and empties it completely at the
+//! end of every round, after which every slot it used but the root leaf must
+//! have been given back. Build from the repository root against the host
+//! memory backend, or let test/run.sh build it in several configurations:
+//!
+//!     cc -O2 -DATOMIC_LOCKS -DTREE_ORDER=4 -DMAX_NODES_PER_LEVEL=4096
+//!         -DMAX_LEVELS=10 -I. test/random-ops.c alloc.c erase.c insert.c
+//!         insert-helpers.c memory-host.c node.c scan.c search.c split.c
+//!         tree-helpers.c -o random-ops
+//!
+//! Usage: `random-ops [rounds] [operations per round] [seed]`
+
+#include "alloc.h"
+#include "erase.h"
+#include "insert.h"
+#include "memory.h"
+#include "node.h"
+#include "scan.h"
+#include "search.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//! @brief Keys are drawn from 1 up to this
+#define KEY_SPACE (2048)
+//! @brief Most entries compared by a single scan
+#define SCAN_LIMIT (64)
+//! @brief Most keys given to a single @ref insert_batch
+#define BATCH_LIMIT (64)
+//! @brief Width of the range each batch's keys are drawn from, so that a
+//!        batch covers a few neighbouring leaves
+#define BATCH_SPAN (256)
+
+
+//! @brief Contents the tree should have
+typedef struct {
+	bool present[KEY_SPACE + 1];
+	bdata_t value[KEY_SPACE + 1];
+} Reference;
+
+//! @brief Progress of a scan compared against the reference
+typedef struct {
+	Reference const *ref;
+	bkey_t expected;
+	bkey_t hi;
+	bool ok;
+} ScanCheck;
+
+
+//! @brief xorshift64* pseudorandom number generator
+static uint64_t next_rand(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//! @brief Smallest key present in the reference from a key upwards
+//! @return The key, or @p hi if there is none below it
+static bkey_t next_present(Reference const *ref, bkey_t key, bkey_t hi) {
+	while (key < hi && (key > KEY_SPACE || !ref->present[key])) ++key;
+	return key;
+}
+
+//! @brief Check one scanned entry against the next key in the reference
+static bool check_entry(bkey_t key, bval_t value, void *ctx) {
+	ScanCheck *check = ctx;
+	if (key != check->expected || value.data != check->ref->value[key]) {
+		fprintf(stderr, "Scan visited %u = %d, expected %u\n",
+			key, value.data, check->expected);
+		check->ok = false;
+		return false;
+	}
+	check->expected = next_present(check->ref, key + 1, check->hi);
+	return true;
+}
+
+//! @brief Scan part of a random range, paged, and compare against the
+//!        reference
+static bool check_scan(bptr_t root, Reference const *ref, uint64_t *rng) {
+	const bkey_t lo = 1 + next_rand(rng) % KEY_SPACE;
+	const bkey_t hi = lo + next_rand(rng) % (KEY_SPACE / 4);
+	ScanCheck check = {ref, next_present(ref, lo, hi), hi, true};
+	ScanCursor cursor;
+	size_t count;
+	ErrorCode status;
+
+	scan_init(&cursor, lo, hi);
+	while (!cursor.done) {
+		status = scan(root, &cursor, SCAN_LIMIT, check_entry, &check, &count);
+		if (status != SUCCESS || !check.ok) {
+			fprintf(stderr, "Scan of [%u, %u) failed: %s\n",
+				lo, hi, ERROR_CODE_NAMES[status]);
+			return false;
+		}
+	}
+	if (check.expected != hi) {
+		fprintf(stderr, "Scan of [%u, %u) missed %u\n", lo, hi, check.expected);
+		return false;
+	}
+	return true;
+}
+
+//! @brief Order keys for qsort
+static int compare_keys(void const *a, void const *b) {
+	const bkey_t x = *(bkey_t const *) a, y = *(bkey_t const *) b;
+	return (x > y) - (x < y);
+}
+
+//! @brief Insert a sorted batch of random keys, some of them repeated, and
+//!        check the status of each against the reference
+static bool check_batch(bptr_t *root, Reference *ref, uint64_t *rng) {
+	const size_t n = 1 + next_rand(rng) % BATCH_LIMIT;
+	const bkey_t lo = 1 + next_rand(rng) % (KEY_SPACE - BATCH_SPAN + 1);
+	bkey_t keys[BATCH_LIMIT];
+	bval_t values[BATCH_LIMIT];
+	ErrorCode statuses[BATCH_LIMIT];
+	ErrorCode status, expected;
+
+	for (size_t i = 0; i < n; ++i) {
+		keys[i] = lo + next_rand(rng) % BATCH_SPAN;
+	}
+	qsort(keys, n, sizeof(bkey_t), compare_keys);
+	for (size_t i = 0; i < n; ++i) {
+		values[i].data = (bdata_t) (next_rand(rng) >> 33);
+	}
+	status = insert_batch(root, keys, values, n, statuses);
+	if (status != SUCCESS) {
+		fprintf(stderr, "Batch of %zu keys from %u failed: %s\n",
+			n, lo, ERROR_CODE_NAMES[status]);
+		return false;
+	}
+	// Only the first of any repeated keys goes in
+	for (size_t i = 0; i < n; ++i) {
+		expected = ref->present[keys[i]] ? KEY_EXISTS : SUCCESS;
+		if (statuses[i] != expected) {
+			fprintf(stderr, "Batch insert of %u returned %s, expected %s\n",
+				keys[i], ERROR_CODE_NAMES[statuses[i]],
+				ERROR_CODE_NAMES[expected]);
+			return false;
+		}
+		if (expected == SUCCESS) {
+			ref->present[keys[i]] = true;
+			ref->value[keys[i]] = values[i].data;
+		}
+	}
+	return true;
+}
+
+//! @brief Number of slots the allocator holds on every level
+static bptr_t total_slots_used() {
+	bptr_t total = 0;
+	for (uint_fast8_t level = 0; level < MAX_LEVELS; ++level) {
+		total += slots_used(level);
+	}
+	return total;
+}
+
+//! @brief Apply one random operation to both the tree and the reference
+//! @param[in] grow  Whether inserts should outnumber erases
+static bool step(bptr_t *root, Reference *ref, uint64_t *rng, bool grow) {
+	const bkey_t key = 1 + next_rand(rng) % KEY_SPACE;
+	const unsigned op = next_rand(rng) % 64;
+	ErrorCode status, expected;
+	bstatusval_t found;
+
+	if (grow && op == 0) {
+		return check_batch(root, ref, rng);
+	} else if (op < (grow ? 28 : 16)) {
+		const bval_t value = {.data = (bdata_t) (next_rand(rng) >> 33)};
+		status = insert(root, key, value);
+		expected = ref->present[key] ? KEY_EXISTS : SUCCESS;
+		if (status == SUCCESS) {
+			ref->present[key] = true;
+			ref->value[key] = value.data;
+		}
+	} else if (op < 44) {
+		status = erase(root, key);
+		expected = ref->present[key] ? SUCCESS : NOT_FOUND;
+		if (status == SUCCESS) {
+			ref->present[key] = false;
+		}
+	} else if (op < 60) {
+		found = search(*root, key);
+		status = found.status;
+		expected = ref->present[key] ? SUCCESS : NOT_FOUND;
+		if (status == SUCCESS && found.value.data != ref->value[key]) {
+			fprintf(stderr, "Search for %u found %d, expected %d\n",
+				key, found.value.data, ref->value[key]);
+			return false;
+		}
+	} else {
+		return check_scan(*root, ref, rng);
+	}
+	if (status != expected) {
+		fprintf(stderr, "Operation %u on key %u returned %s, expected %s\n",
+			op, key, ERROR_CODE_NAMES[status], ERROR_CODE_NAMES[expected]);
+		return false;
+	}
+	return true;
+}
+
+
+int main(int argc, char **argv) {
+	const size_t n_rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20;
+	const size_t n_ops = (argc > 2) ? strtoul(argv[2], NULL, 0) : 20000;
+	uint64_t rng = (argc > 3)
+		? strtoull(argv[3], NULL, 0) : 88172645463325252ULL;
+	static Reference ref;
+	bptr_t root = 0;
+	bptr_t empty_slots;
+
+	mem_reset_all();
+	alloc_rebuild();
+	empty_slots = total_slots_used();
+
+	for (size_t round = 0; round < n_rounds; ++round) {
+		for (size_t i = 0; i < n_ops; ++i) {
+			if (!step(&root, &ref, &rng, i < n_ops / 2)) {
+				fprintf(stderr, "Failed in round %zu, operation %zu\n",
+					round, i);
+				return EXIT_FAILURE;
+			}
+		}
+		// Empty the tree, and check that it gave back everything it used
+		for (bkey_t key = 1; key <= KEY_SPACE; ++key) {
+			if (ref.present[key] && erase(&root, key) != SUCCESS) {
+				fprintf(stderr, "Failed to empty the tree at %u\n", key);
+				return EXIT_FAILURE;
+			}
+			ref.present[key] = false;
+		}
+		if (!is_leaf(root) || total_slots_used() > empty_slots + 1) {
+			fprintf(stderr, "Round %zu left %u slots in use, expected %u\n",
+				round, total_slots_used(), empty_slots + 1);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("random-ops: %zu rounds of %zu operations passed\n",
+		n_rounds, n_ops);
+	return EXIT_SUCCESS;
+}
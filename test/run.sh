@@ -0,0 +1,46 @@
+#!/bin/sh
+# Build every test under test/ in each configuration and run it, stopping at
+# the first one to fail.
+#
+# Run from anywhere; binaries go under test/build. Every setting can be
+# overridden from the environment, for example:
+#
+#     CFLAGS="-O1 -g -fsanitize=address,undefined" TESTS=random-ops test/run.sh
+#
+# VARIANTS holds the extra flags for each configuration, separated by
+# semicolons. All of them share the memory geometry in GEOMETRY, which is
+# large enough for every test.
+
+set -eu
+
+cd "$(dirname "$0")/.."
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -g}
+GEOMETRY=${GEOMETRY:-"-DMAX_NODES_PER_LEVEL=16384 -DMAX_LEVELS=10"}
+VARIANTS=${VARIANTS:-"-DTREE_ORDER=4;-DTREE_ORDER=8 -DELASTIC_LEVELS;-DTREE_ORDER=16 -DREDISTRIBUTE;-DTREE_ORDER=8 -DALIGNED_NODES -DNODE_CACHE"}
+TESTS=${TESTS:-"random-ops concurrent-readers concurrent-writers"}
+BUILD=${BUILD:-test/build}
+
+SOURCES="alloc.c bulk-load.c erase.c insert.c insert-helpers.c memory-host.c
+	memory-trace.c node.c node-cache.c scan.c search.c split.c stats.c
+	tree-helpers.c"
+
+mkdir -p "$BUILD"
+n_variant=0
+default_ifs=$IFS
+IFS=';'
+for variant in $VARIANTS; do
+	n_variant=$((n_variant + 1))
+	IFS=$default_ifs
+	for test in $TESTS; do
+		binary="$BUILD/$test-$n_variant"
+		echo "== $test $variant"
+		# shellcheck disable=SC2086
+		$CC $CFLAGS -pthread -DATOMIC_LOCKS $GEOMETRY $variant -I. \
+			"test/$test.c" $SOURCES -o "$binary"
+		"$binary"
+	done
+	IFS=';'
+done
+echo "All tests passed"
@@ -12,18 +12,66 @@
 //! @return An error code representing the success or type of failure of the
 //!         operation
 ErrorCode trace_lineage(bptr_t root, bkey_t key, bptr_t *lineage) {
-	lineage[0] = root;
-	li_t curr = 0;
+	return trace_to_level(root, key, 0, lineage);
+}
+
+
+ErrorCode trace_to_level(
+	bptr_t root, bkey_t key, uint_fast8_t level, bptr_t *lineage
+) {
+	li_t curr;
 	Node node;
 	bstatusval_t result;
+	bptr_t prev;
+	bver_t version, prev_version;
+	bool valid;
 
-	// Iterate until we hit a leaf
-	while (!is_leaf(lineage[curr])) {
-		node = mem_read(lineage[curr]);
-		result = find_next(&node, key);
-		if (result.status != SUCCESS) return result.status;
-		lineage[++curr] = result.value.ptr;
-	}
+	do {
+		lineage[0] = root;
+		curr = 0;
+		prev = INVALID;
+		valid = true;
+		// Iterate until we reach the level, starting over if the node we came
+		// from changed while we were reading its child
+		while (get_level(lineage[curr]) > level) {
+			node = mem_read_versioned(lineage[curr], &version);
+			valid = prev == INVALID || mem_validate(prev, prev_version);
+			if (!valid) break;
+			prev = lineage[curr];
+			prev_version = version;
+			if (past_high_key(&node, key)) {
+				// The node split after its parent was read; its right
+				// sibling takes its place on the path
+				lineage[curr] = node.next;
+			} else {
+				result = find_next(&node, key);
+				if (result.status != SUCCESS) return result.status;
+				lineage[++curr] = result.value.ptr;
+			}
+		}
+		if (!valid) STATS_INC(restarts);
+	} while (!valid);
+	// Drop anything left over from an abandoned, deeper traversal
+	for (li_t i = curr+1; i < MAX_LEVELS; ++i) lineage[i] = INVALID;
 
 	return SUCCESS;
 }
+
+
+bool move_right(AddrNode *node, bkey_t key) {
+	while (past_high_key(&node->node, key)) {
+		const bptr_t next = node->node.next;
+		STATS_INC(right_moves);
+		// Lock the sibling before letting go of the node pointing to it
+		const Node next_node = mem_read_lock(next);
+		mem_unlock(node->addr);
+		node->addr = next;
+		node->node = next_node;
+	}
+	if (before_low_key(&node->node, key)) {
+		STATS_INC(restarts);
+		mem_unlock(node->addr);
+		return false;
+	}
+	return true;
+}
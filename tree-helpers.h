@@ -3,6 +3,8 @@
 
 
 #include "types.h"
+#include <stdbool.h>
+typedef struct AddrNode AddrNode;
 
 
 //! @brief Get the index of a leaf in a lineage array
@@ -26,5 +28,34 @@ inline static uint_fast8_t get_leaf_idx(bptr_t const *lineage) {
 //!         operation
 ErrorCode trace_lineage(bptr_t root, bkey_t key, bptr_t *lineage);
 
+//! @brief Like @ref trace_lineage, but stop at a node on the given level
+//!
+//! Nodes below the level are not read, so a node on the level may be locked
+//! by the caller without the traversal waiting on it forever.
+//! @param[in]  root     Root of the tree to search
+//! @param[in]  key      The key to search for
+//! @param[in]  level    Level to stop at, the leaves being 0
+//! @param[out] lineage  As for @ref trace_lineage, ending on the level
+//! @return An error code representing the success or type of failure of the
+//!         operation
+ErrorCode trace_to_level(
+	bptr_t root, bkey_t key, uint_fast8_t level, bptr_t *lineage
+);
+
+//! @brief Follow a locked node's right links until it covers a key
+//!
+//! A node found through a stale parent may have split, moving the key to a
+//! sibling to its right. Each sibling is locked before its left neighbour is
+//! released, so the node can not split out from under the key in between.
+//! The key may instead have moved left, or the node been removed, after an
+//! erase, in which case there is no way to reach the key from here.
+//! @param[inout] node  A locked node, replaced with the locked node whose range
+//!                     includes the key
+//! @param[in]    key   The key the node must cover
+//! @return True if @p node now covers the key, false if the key lies to the
+//!         left, in which case @p node has been unlocked and the caller must
+//!         start over from the root
+bool move_right(AddrNode *node, bkey_t key);
+
 
 #endif
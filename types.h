@@ -12,6 +12,8 @@ typedef uint32_t bkey_t;
 typedef uint32_t bptr_t;
 //! Datatype of leaf data
 typedef int32_t bdata_t;
+//! Datatype of node version numbers, used to detect concurrent modification
+typedef uint32_t bver_t;
 //! @brief Datatype of node values, which can be either data or pointers within
 //!        the tree
 typedef union {
@@ -34,7 +36,8 @@ typedef uint_fast32_t li_t;
 	X(NOT_FOUND, 3) \
 	X(INVALID_ARGUMENT, 4) \
 	X(OUT_OF_MEMORY, 5) \
-	X(PARENT_FULL, 6)
+	X(PARENT_FULL, 6) \
+	X(IO_ERROR, 7)
 //! @brief Status codes returned from tree functions
 typedef enum {
 #define X(codename, codeval) codename = codeval,